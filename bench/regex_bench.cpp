@@ -0,0 +1,508 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <limits>
+#include <iostream>
+#include <random>
+#include <regex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <malloc.h>
+#include <sys/resource.h>
+
+#include "regex.hpp"
+#include "regex_column.hpp"
+#include "regex_compact.hpp"
+#include "regex_compile.hpp"
+#include "regex_derivative.hpp"
+#include "regex_dfa.hpp"
+#include "regex_nfa.hpp"
+#include "regex_parse.hpp"
+
+using namespace std;
+using clk = chrono::steady_clock;
+
+// Heap bytes in use and their high-water mark, so that a compile can report the peak
+// memory it needed. Over-aligned allocations are not counted.
+static atomic<size_t> heap_live{0}, heap_peak{0};
+
+void* operator new(size_t n) {
+    void* p = malloc(n != 0 ? n : 1);
+    if (p == nullptr) {
+        throw bad_alloc();
+    }
+    size_t live = heap_live.fetch_add(malloc_usable_size(p), memory_order_relaxed) + malloc_usable_size(p);
+    size_t peak = heap_peak.load(memory_order_relaxed);
+    while (live > peak && !heap_peak.compare_exchange_weak(peak, live, memory_order_relaxed)) {}
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    if (p != nullptr) {
+        heap_live.fetch_sub(malloc_usable_size(p), memory_order_relaxed);
+        free(p);
+    }
+}
+
+void operator delete(void* p, size_t) noexcept {
+    operator delete(p);
+}
+
+struct corpus {
+    string name;
+    vector<string> lines;
+    size_t bytes;
+};
+
+struct bench_case {
+    string name;
+    string pattern;
+    const corpus* input;
+    bool compare_std;
+};
+
+struct bench_row {
+    string name;
+    string corpus;
+    string engine;
+    double tokenize_us = 0, build_nfa_us = 0, subset_us = 0, simplify_us = 0, parallel_compile_us = 0;
+    size_t nfa_states_unsimplified = 0, nfa_states = 0, dfa_states_raw = 0, dfa_states = 0;
+    double match_mb_s = 0, batch_mb_s = 0, search_mb_s = 0, scan_mb_s = 0, stream_mb_s = 0, compact_mb_s = 0;
+    size_t table_bytes = 0, compact_bytes = 0;
+    size_t compile_peak_kb = 0;
+    size_t matched = 0;
+};
+
+// Peak of the whole process, which never decreases, so it is only reported once at the end
+static long peak_rss_kb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Runs fn repeatedly for at least min_seconds and returns seconds per run
+static double measure(const function<void()>& fn, double min_seconds = 0.2) {
+    size_t runs = 0;
+    auto begin = clk::now();
+    double elapsed;
+    do {
+        fn();
+        runs++;
+        elapsed = chrono::duration<double>(clk::now() - begin).count();
+    } while (elapsed < min_seconds);
+    return elapsed / runs;
+}
+
+static double time_once_us(const function<void()>& fn) {
+    auto begin = clk::now();
+    fn();
+    return chrono::duration<double, micro>(clk::now() - begin).count();
+}
+
+static corpus make_corpus(const string& name, vector<string> lines) {
+    size_t bytes = 0;
+    for (auto& line : lines) bytes += line.size();
+    return corpus{name, std::move(lines), bytes};
+}
+
+static corpus log_corpus(mt19937& rng, size_t n) {
+    static const char* levels[] = {"INFO", "WARN", "ERROR", "DEBUG"};
+    static const char* words[] = {"connection", "reset", "by", "peer", "request", "served", "in", "cache", "miss", "user", "login", "timeout"};
+    vector<string> lines;
+    for (size_t i = 0; i < n; i++) {
+        stringstream ss;
+        ss << "2024-0" << rng() % 9 + 1 << "-1" << rng() % 10 << ' '
+           << setw(2) << setfill('0') << rng() % 24 << ':' << setw(2) << rng() % 60 << ':' << setw(2) << rng() % 60 << ' '
+           << levels[rng() % 4];
+        size_t wc = 3 + rng() % 6;
+        for (size_t w = 0; w < wc; w++) ss << ' ' << words[rng() % 12];
+        lines.push_back(ss.str());
+    }
+    return make_corpus("logs", std::move(lines));
+}
+
+static corpus random_corpus(mt19937& rng, size_t n) {
+    vector<string> lines;
+    for (size_t i = 0; i < n; i++) {
+        string line(20 + rng() % 100, ' ');
+        for (char& c : line) c = static_cast<char>(0x20 + rng() % 0x5f);
+        lines.push_back(std::move(line));
+    }
+    return make_corpus("random", std::move(lines));
+}
+
+static corpus adversarial_corpus(mt19937& rng, size_t n) {
+    vector<string> lines;
+    for (size_t i = 0; i < n; i++) {
+        size_t len = 8 + rng() % 16;
+        string line;
+        switch (i % 3) {
+        case 0: line = string(len, 'a'); break;
+        case 1: for (size_t j = 0; j < len; j++) line += (rng() & 1) ? 'a' : 'b'; break;
+        default: line = string(len, 'a') + 'b'; break;
+        }
+        lines.push_back(std::move(line));
+    }
+    return make_corpus("adversarial", std::move(lines));
+}
+
+// A column of request paths drawn from a few distinct values, as a log table would hold
+static corpus column_corpus(mt19937& rng, size_t n, size_t distinct) {
+    static const char* resources[] = {"users", "orders", "items", "carts", "sessions"};
+    vector<string> values;
+    for (size_t i = 0; i < distinct; i++) {
+        stringstream ss;
+        ss << "/api/v" << rng() % 3 + 1 << '/' << resources[rng() % 5] << '/' << rng() % 100000;
+        if (rng() % 2) ss << "/details";
+        values.push_back(ss.str());
+    }
+    vector<string> lines;
+    for (size_t i = 0; i < n; i++) {
+        lines.push_back(values[rng() % distinct]);
+    }
+    return make_corpus("column", std::move(lines));
+}
+
+static string ab_suffix_pattern(size_t n) {
+    string p = "(a|b)*a";
+    for (size_t i = 0; i < n; i++) p += "(a|b)";
+    return p;
+}
+
+static string literal_alternation(mt19937& rng, size_t n) {
+    string p;
+    for (size_t i = 0; i < n; i++) {
+        if (i) p += '|';
+        size_t len = 4 + rng() % 6;
+        for (size_t j = 0; j < len; j++) p += static_cast<char>('a' + rng() % 26);
+    }
+    return p;
+}
+
+static bench_row run_case(const bench_case& bc, const regexs::compile_options& options = {}, const string& engine = "regexs") {
+    bench_row row;
+    row.name = bc.name;
+    row.corpus = bc.input->name;
+    row.engine = engine;
+
+    vector<shared_ptr<regexs::token>> tokens;
+    regexs::nondeterministic_automaton nfa;
+    regexs::deterministic_automaton dfa;
+    size_t heap_before = heap_live.load();
+    heap_peak = heap_before;
+    row.tokenize_us = time_once_us([&] { tokens = regexs::regex_tokenize(bc.pattern); });
+    if (options.derivatives) {
+        // The derivative rows report parsing as build_nfa and the construction as
+        // subset_construction; their DFAs are not simplified
+        regexs::pattern_node::pointer pattern;
+        row.build_nfa_us = time_once_us([&] { pattern = regexs::simplify_pattern(regexs::parse_pattern(tokens)); });
+        row.subset_us = time_once_us([&] { dfa = regexs::derivative_dfa(*pattern); });
+        row.compile_peak_kb = (heap_peak - heap_before) / 1024;
+        row.dfa_states_raw = row.dfa_states = dfa.state_count();
+    } else {
+        row.build_nfa_us = time_once_us([&] { nfa = regexs::build_nfa(tokens); });
+        row.subset_us = time_once_us([&] { dfa = nfa.subset_construction(); });
+        row.dfa_states_raw = dfa.state_count();
+        row.simplify_us = time_once_us([&] { dfa.simplify(); });
+        row.compile_peak_kb = (heap_peak - heap_before) / 1024;
+        row.nfa_states = nfa.state_count();
+        row.nfa_states_unsimplified = regexs::pattern_automaton(*regexs::parse_pattern(tokens)).state_count();
+        row.dfa_states = dfa.state_count();
+
+        regexs::compile_options parallel;
+        parallel.threads = max(2u, thread::hardware_concurrency());
+        row.parallel_compile_us = time_once_us([&] { regexs::compile_dfa(nfa, parallel); });
+    }
+
+    regexs::regex re(bc.pattern, options);
+    re.deter_automaton();
+    re.reverse_automaton();
+    re.scan_lines("", [](size_t, size_t) {});
+
+    double bytes = static_cast<double>(bc.input->bytes);
+    double match_s = measure([&] {
+        size_t matched = 0;
+        for (auto& line : bc.input->lines) matched += re.match(line);
+        row.matched = matched;
+    });
+    // Always built here, even below the size where regex switches to it
+    regexs::transition_table table(re.deter_automaton());
+    regexs::compact_table compact(table);
+    row.table_bytes = table.state_count() * table.class_count() * sizeof(regexs::transition_table::state);
+    row.compact_bytes = compact.memory_usage();
+    double compact_s = measure([&] {
+        size_t matched = 0;
+        for (auto& line : bc.input->lines) matched += compact.is_stop_state(compact.run(compact.start_state(), line));
+        row.matched = matched;
+    });
+    vector<string_view> views(bc.input->lines.begin(), bc.input->lines.end());
+    double batch_s = measure([&] {
+        re.match_batch(views);
+    });
+    double search_s = measure([&] {
+        for (auto& line : bc.input->lines) re.search(line);
+    });
+    string buffer;
+    for (auto& line : bc.input->lines) {
+        buffer += line;
+        buffer += '\n';
+    }
+    double scan_s = measure([&] {
+        size_t lines = 0;
+        re.scan_lines(buffer, [&](size_t, size_t) { lines++; });
+    });
+    const size_t chunk = 4096;
+    size_t stream_matches = 0;
+    regexs::stream_matcher stream = re.stream([&](size_t, const set<int>&) { stream_matches++; });
+    double stream_s = measure([&] {
+        stream.reset();
+        for (size_t i = 0; i < buffer.size(); i += chunk) {
+            stream.feed(string_view(buffer).substr(i, chunk));
+        }
+        stream.finish();
+    });
+    row.match_mb_s = bytes / match_s / 1e6;
+    row.batch_mb_s = bytes / batch_s / 1e6;
+    row.search_mb_s = bytes / search_s / 1e6;
+    row.scan_mb_s = buffer.size() / scan_s / 1e6;
+    row.stream_mb_s = buffer.size() / stream_s / 1e6;
+    row.compact_mb_s = bytes / compact_s / 1e6;
+    return row;
+}
+
+// Approximate patterns only match, search and scan lines, on the bit-parallel engine
+static bench_row run_approximate_case(const bench_case& bc, size_t edits) {
+    bench_row row;
+    row.name = bc.name;
+    row.corpus = bc.input->name;
+    row.engine = "regexs/k=" + to_string(edits);
+
+    regexs::compile_options options;
+    options.max_edits = edits;
+    unique_ptr<regexs::regex> re;
+    size_t heap_before = heap_live.load();
+    heap_peak = heap_before;
+    row.build_nfa_us = time_once_us([&] { re = make_unique<regexs::regex>(bc.pattern, options); });
+    row.compile_peak_kb = (heap_peak - heap_before) / 1024;
+
+    double bytes = static_cast<double>(bc.input->bytes);
+    double match_s = measure([&] {
+        size_t matched = 0;
+        for (auto& line : bc.input->lines) matched += re->match(line);
+        row.matched = matched;
+    });
+    vector<string_view> views(bc.input->lines.begin(), bc.input->lines.end());
+    double batch_s = measure([&] {
+        re->match_batch(views);
+    });
+    double search_s = measure([&] {
+        for (auto& line : bc.input->lines) re->search(line);
+    });
+    string buffer;
+    for (auto& line : bc.input->lines) {
+        buffer += line;
+        buffer += '\n';
+    }
+    double scan_s = measure([&] {
+        size_t lines = 0;
+        re->scan_lines(buffer, [&](size_t, size_t) { lines++; });
+    });
+    row.match_mb_s = bytes / match_s / 1e6;
+    row.batch_mb_s = bytes / batch_s / 1e6;
+    row.search_mb_s = bytes / search_s / 1e6;
+    row.scan_mb_s = buffer.size() / scan_s / 1e6;
+    return row;
+}
+
+// The column matcher on plain values (match) and on the same column dictionary-encoded
+// (batch); its cache stays warm across runs
+static bench_row run_column_case(const bench_case& bc, const regexs::compile_options& options, regexs::column_matcher::cache_stats& cache) {
+    bench_row row;
+    row.name = bc.name;
+    row.corpus = bc.input->name;
+    row.engine = "regexs/column";
+
+    regexs::regex re(bc.pattern, options);
+    regexs::column_matcher column(re);
+    vector<string_view> views(bc.input->lines.begin(), bc.input->lines.end());
+    vector<string_view> dictionary;
+    vector<uint32_t> codes;
+    unordered_map<string_view, uint32_t> seen;
+    for (string_view value : views) {
+        auto [it, inserted] = seen.emplace(value, static_cast<uint32_t>(dictionary.size()));
+        if (inserted) dictionary.push_back(value);
+        codes.push_back(it->second);
+    }
+
+    double bytes = static_cast<double>(bc.input->bytes);
+    double match_s = measure([&] {
+        auto result = column.match(views);
+        row.matched = count(result.matched.begin(), result.matched.end(), true);
+    });
+    double batch_s = measure([&] {
+        column.match(dictionary, codes);
+    });
+    row.match_mb_s = bytes / match_s / 1e6;
+    row.batch_mb_s = bytes / batch_s / 1e6;
+    cache = column.stats();
+    return row;
+}
+
+static bench_row run_std_case(const bench_case& bc) {
+    bench_row row;
+    row.name = bc.name;
+    row.corpus = bc.input->name;
+    row.engine = "std::regex";
+
+    std::regex re;
+    row.build_nfa_us = time_once_us([&] { re = std::regex(bc.pattern); });
+
+    double bytes = static_cast<double>(bc.input->bytes);
+    double match_s = measure([&] {
+        size_t matched = 0;
+        for (auto& line : bc.input->lines) matched += regex_match(line, re);
+        row.matched = matched;
+    });
+    double search_s = measure([&] {
+        for (auto& line : bc.input->lines) regex_search(line, re);
+    });
+    row.match_mb_s = bytes / match_s / 1e6;
+    row.search_mb_s = bytes / search_s / 1e6;
+    return row;
+}
+
+static void print_csv_header(ostream& os) {
+    os << "case,corpus,engine,tokenize_us,build_nfa_us,subset_construction_us,simplify_us,parallel_compile_us,"
+          "nfa_states_unsimplified,nfa_states,dfa_states_raw,dfa_states,corpus_bytes,matched,match_mb_s,batch_mb_s,search_mb_s,scan_lines_mb_s,stream_mb_s,compact_mb_s,table_bytes,compact_bytes,compile_peak_kb\n";
+}
+
+static void print_csv_row(ostream& os, const bench_row& row, size_t corpus_bytes) {
+    os << row.name << ',' << row.corpus << ',' << row.engine << ','
+       << row.tokenize_us << ',' << row.build_nfa_us << ',' << row.subset_us << ',' << row.simplify_us << ',' << row.parallel_compile_us << ','
+       << row.nfa_states_unsimplified << ',' << row.nfa_states << ',' << row.dfa_states_raw << ',' << row.dfa_states << ','
+       << corpus_bytes << ',' << row.matched << ',' << row.match_mb_s << ',' << row.batch_mb_s << ',' << row.search_mb_s << ',' << row.scan_mb_s << ',' << row.stream_mb_s << ','
+       << row.compact_mb_s << ',' << row.table_bytes << ',' << row.compact_bytes << ','
+       << row.compile_peak_kb << '\n';
+}
+
+static void print_table_row(const bench_row& row) {
+    cout << left << setw(22) << row.name << setw(13) << row.corpus << setw(12) << row.engine << right
+         << setw(10) << fixed << setprecision(1) << row.subset_us + row.simplify_us + row.build_nfa_us + row.tokenize_us
+         << setw(8) << row.compile_peak_kb << setw(8) << row.nfa_states << setw(8) << row.dfa_states
+         << setw(10) << setprecision(2) << row.match_mb_s << setw(10) << row.batch_mb_s << setw(10) << row.search_mb_s << setw(10) << row.scan_mb_s << setw(10) << row.stream_mb_s << setw(10) << row.compact_mb_s << '\n';
+}
+
+int main(int argc, char** argv) {
+    string output_path = argc > 1 ? argv[1] : "bench_results.csv";
+
+    mt19937 rng(20240601);
+    corpus logs = log_corpus(rng, 2000);
+    corpus text = random_corpus(rng, 2000);
+    corpus adversarial = adversarial_corpus(rng, 2000);
+    corpus paths = column_corpus(rng, 20000, 64);
+
+    vector<bench_case> cases = {
+        {"log_line", "2024-[0-9]+-[0-9]+ [0-9:]+ (INFO|WARN|ERROR|DEBUG)( [a-z]+)+", &logs, true},
+        {"log_error", "2024-[0-9-]+ [0-9:]+ ERROR( [a-z]+)*", &logs, true},
+        {"printable", "[ -~]*", &text, true},
+        {"nested_stars", "((a*)*b)*", &adversarial, false},
+        {"nested_stars_2", "((a|b)*(a*)*)*c", &adversarial, false},
+        {"ab_suffix_4", ab_suffix_pattern(4), &adversarial, true},
+        {"ab_suffix_8", ab_suffix_pattern(8), &adversarial, true},
+        {"ab_suffix_12", ab_suffix_pattern(12), &adversarial, true},
+        {"literal", "connection reset", &logs, true},
+        {"literal_alt_200", literal_alternation(rng, 200), &text, true},
+    };
+
+    ofstream csv(output_path);
+    print_csv_header(csv);
+
+    cout << left << setw(22) << "case" << setw(13) << "corpus" << setw(12) << "engine" << right
+         << setw(10) << "compile" << setw(8) << "peak" << setw(8) << "nfa" << setw(8) << "dfa"
+         << setw(10) << "match" << setw(10) << "batch" << setw(10) << "search" << setw(10) << "lines" << setw(10) << "stream" << setw(10) << "compact" << '\n';
+    cout << left << setw(22) << "" << setw(13) << "" << setw(12) << "" << right
+         << setw(10) << "us" << setw(8) << "KB" << setw(8) << "states" << setw(8) << "states"
+         << setw(10) << "MB/s" << setw(10) << "MB/s" << setw(10) << "MB/s" << setw(10) << "MB/s" << setw(10) << "MB/s" << setw(10) << "MB/s" << '\n';
+
+    // The main rows measure the automata in steady state; the bit-parallel engine that
+    // runs before them gets a row of its own
+    regexs::compile_options steady;
+    steady.bit_parallel_bytes = 0;
+
+    for (const bench_case& bc : cases) {
+        bench_row row = run_case(bc, steady);
+        print_table_row(row);
+        print_csv_row(csv, row, bc.input->bytes);
+
+        regexs::compile_options derivatives = steady;
+        derivatives.derivatives = true;
+        bench_row derivative_row = run_case(bc, derivatives, "regexs/deriv");
+        print_table_row(derivative_row);
+        print_csv_row(csv, derivative_row, bc.input->bytes);
+
+        // Literal patterns get a second row through the automata they bypass
+        if (regexs::regex(bc.pattern).engine() == regexs::regex::LITERAL) {
+            regexs::compile_options no_literals = steady;
+            no_literals.max_literals = 0;
+            bench_row dfa_row = run_case(bc, no_literals, "regexs/dfa");
+            print_table_row(dfa_row);
+            print_csv_row(csv, dfa_row, bc.input->bytes);
+        }
+
+        // Patterns with few positions get a row that stays on the bit-parallel engine
+        if (regexs::regex(bc.pattern).engine() == regexs::regex::BIT_PARALLEL) {
+            regexs::compile_options bit_parallel;
+            bit_parallel.bit_parallel_bytes = numeric_limits<size_t>::max();
+            bench_row bit_parallel_row = run_case(bc, bit_parallel, "regexs/bitpar");
+            print_table_row(bit_parallel_row);
+            print_csv_row(csv, bit_parallel_row, bc.input->bytes);
+        }
+
+        if (bc.compare_std) {
+            bench_row std_row = run_std_case(bc);
+            print_table_row(std_row);
+            print_csv_row(csv, std_row, bc.input->bytes);
+        }
+    }
+
+    vector<bench_case> approximate_cases = {
+        {"fuzzy_literal", "connection reset", &logs, false},
+        {"fuzzy_log_error", "ERROR( [a-z]+)+", &logs, false},
+    };
+    for (const bench_case& bc : approximate_cases) {
+        for (size_t edits : {1, 2}) {
+            bench_row row = run_approximate_case(bc, edits);
+            print_table_row(row);
+            print_csv_row(csv, row, bc.input->bytes);
+        }
+    }
+
+    vector<bench_case> column_cases = {
+        {"column_path", "/api/v[12]/(users|orders)/[0-9]+(/details)?", &paths, false},
+    };
+    for (const bench_case& bc : column_cases) {
+        bench_row plain_row = run_case(bc, steady);
+        print_table_row(plain_row);
+        print_csv_row(csv, plain_row, bc.input->bytes);
+
+        regexs::column_matcher::cache_stats cache;
+        bench_row row = run_column_case(bc, steady, cache);
+        print_table_row(row);
+        print_csv_row(csv, row, bc.input->bytes);
+        cout << "  cache: " << cache.hits << " hits, " << cache.misses << " misses, " << cache.uncached << " uncached, hit rate " << cache.hit_rate() << '\n';
+    }
+
+    cout << "process peak RSS " << peak_rss_kb() << " KB\n";
+    cout << "results written to " << output_path << '\n';
+    return 0;
+}
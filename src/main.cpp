@@ -1,10 +1,19 @@
+#include <charconv>
 #include <iostream>
+#include <memory>
+#include <optional>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include "regex.hpp"
+#include "regex_compile.hpp"
 #include "regex_dfa.hpp"
+#include "regex_input.hpp"
 #include "regex_nfa.hpp"
+#include "regex_set.hpp"
+#include "regex_table.hpp"
 
 using namespace std;
 using regexs::regex;
@@ -24,28 +33,179 @@ static string serialize_set(const set<T>& s) {
     return ss.str();
 }
 
+static int usage_error(string_view message) {
+    cerr << "mygrep: " << message << '\n'
+         << "usage: mygrep [options] PATTERN [FILE...]\n";
+    return 2;
+}
+
+// Reads the value of a --name=N option; false unless it is a whole decimal number
+static bool parse_count(string_view value, size_t& count) {
+    auto [end, ec] = from_chars(value.data(), value.data() + value.size(), count);
+    return !value.empty() && ec == errc() && end == value.data() + value.size();
+}
+
+// mygrep [options] PATTERN [FILE...]: prints the lines that contain a match
+static int grep_main(const vector<string>& positional, const regexs::compile_options& options, bool show_stats, bool show_profile) {
+    optional<regex> compiled;
+    try {
+        compiled.emplace(positional[0], options);
+        if (show_stats) {
+            cerr << compiled->stats().serialize();
+        }
+    } catch (const exception& e) {
+        cerr << "mygrep: " << e.what() << '\n';
+        return 2;
+    }
+    const regex& re = *compiled;
+
+    vector<string> paths(positional.begin() + 1, positional.end());
+    if (paths.empty()) {
+        paths.push_back("-");
+    }
+
+    bool any_match = false, any_error = false;
+    for (const string& path : paths) {
+        unique_ptr<regexs::line_reader> reader = regexs::line_reader::open(path);
+        if (reader == nullptr) {
+            cerr << "mygrep: " << path << ": cannot open file\n";
+            any_error = true;
+            continue;
+        }
+
+        string_view block;
+        while (reader->next(block)) {
+            re.scan_lines(block, [&](size_t begin, size_t end) {
+                if (paths.size() > 1) {
+                    cout << path << ':';
+                }
+                cout.write(block.data() + begin, end - begin) << '\n';
+                any_match = true;
+            });
+        }
+        if (reader->failed()) {
+            cerr << "mygrep: " << path << ": read error\n";
+            any_error = true;
+        }
+    }
+
+    if (show_profile) {
+        if (regexs::table_profile::ENABLED) {
+            cerr << re.profile_report();
+        } else {
+            cerr << "mygrep: built without REGEX_PROFILE, rebuild with make PROFILE=1\n";
+        }
+    }
+
+    return any_error ? 2 : (any_match ? 0 : 1);
+}
+
 int main(int argc, char **argv) {
+    bool show_stats = false, show_profile = false;
+    regexs::compile_options options;
+    vector<string> positional;
+    bool options_done = false;
+    for (int i = 1; i < argc; i++) {
+        string_view arg(argv[i]);
+        if (options_done || arg == "-" || arg.substr(0, 1) != "-") {
+            positional.emplace_back(arg);
+        } else if (arg == "--") {
+            options_done = true;
+        } else if (arg == "--stats") {
+            show_stats = true;
+        } else if (arg == "--profile") {
+            show_profile = true;
+            options.profile = true;
+        } else if (arg == "--derivatives") {
+            options.derivatives = true;
+        } else if (arg == "-i" || arg == "--ignore-case") {
+            options.case_insensitive = true;
+        } else if (arg.substr(0, 13) == "--max-states=") {
+            if (!parse_count(arg.substr(13), options.max_dfa_states)) {
+                return usage_error("invalid value in " + string(arg));
+            }
+        } else if (arg.substr(0, 12) == "--max-bytes=") {
+            if (!parse_count(arg.substr(12), options.max_dfa_bytes)) {
+                return usage_error("invalid value in " + string(arg));
+            }
+        } else if (arg.substr(0, 8) == "--edits=") {
+            if (!parse_count(arg.substr(8), options.max_edits) || options.max_edits > regexs::bit_parallel_nfa::MAX_EDITS) {
+                return usage_error("--edits takes a number from 0 to " + to_string(regexs::bit_parallel_nfa::MAX_EDITS));
+            }
+        } else if (arg.substr(0, 10) == "--threads=") {
+            if (!parse_count(arg.substr(10), options.threads)) {
+                return usage_error("invalid value in " + string(arg));
+            }
+        } else {
+            return usage_error("unknown option " + string(arg));
+        }
+    }
+
+    if (!positional.empty()) {
+        ios::sync_with_stdio(false);
+        return grep_main(positional, options, show_stats, show_profile);
+    }
+    // Pattern sets only match exactly
+    if (options.max_edits > 0) {
+        return usage_error("--edits needs a PATTERN");
+    }
+
     size_t n;
     cout << "输入正则表达式数量：";
     cin >> n;
     while (cin.peek() != '\n') cin.get();
     cin.get();
 
-    regexs::nondeterministic_automaton nfa;
-
-    for (size_t i=0; i<n; i++) {
-        string regex_str;
-        cout << "输入" << i << "号正则表达式：";
-        getline(cin, regex_str);
+    vector<string> patterns(n);
+    try {
+        for (size_t i=0; i<n; i++) {
+            cout << "输入" << i << "号正则表达式：";
+            getline(cin, patterns[i]);
 
-        auto automaton = regex(regex_str).automaton();
-        automaton.add_end_state_mark(i);
-        nfa.add_automaton(nfa.start_single_state(), automaton);
+            if (show_stats) {
+                regex re(patterns[i], options);
+                cout << i << "号正则表达式编译统计：\n" << re.stats().serialize();
+                regex::engine_type engine = re.engine();
+                cout << "引擎：" << (engine == regex::LITERAL ? "字面量" : engine == regex::BIT_PARALLEL ? "位并行" : engine == regex::APPROXIMATE ? "近似" : engine == regex::DFA ? "DFA" : "NFA") << '\n';
+            }
+        }
+    } catch (const exception& e) {
+        cout << "正则表达式无效：" << e.what() << '\n';
+        return 2;
     }
 
-    regexs::deterministic_automaton dfa = nfa.to_deterministic();
-    
-    cout << "确定自动机：\n" << dfa.serialize() << "\n";
+    // The set keeps patterns whose product would pass the shard bound in separate DFAs;
+    // only a pattern that exceeds the budget on its own falls back to the NFA
+    unique_ptr<regexs::regex_set> pattern_set = make_unique<regexs::regex_set>(options);
+    regexs::nondeterministic_automaton nfa;
+    try {
+        for (size_t i=0; i<n; i++) {
+            pattern_set->add(static_cast<int>(i), patterns[i]);
+        }
+        if (pattern_set->shard_count() == 1) {
+            cout << "确定自动机：\n" << pattern_set->deter_automaton().serialize() << "\n";
+        } else {
+            cout << "确定自动机分为" << pattern_set->shard_count() << "个分片\n";
+        }
+    } catch (const regexs::budget_exceeded& e) {
+        cout << "确定自动机超出编译预算（" << e.what() << "），改用NFA模拟\n";
+        pattern_set.reset();
+        for (size_t i=0; i<n; i++) {
+            auto automaton = regex(patterns[i], options).automaton();
+            automaton.add_end_state_mark(i);
+            nfa.add_automaton(nfa.start_single_state(), automaton);
+        }
+    } catch (const exception& e) {
+        cout << "正则表达式无效：" << e.what() << '\n';
+        return 2;
+    }
+    if (show_stats && pattern_set != nullptr) {
+        size_t states = 0;
+        for (size_t k = 0; k < pattern_set->shard_count(); k++) {
+            states += pattern_set->shard_table(k).state_count();
+        }
+        cout << "合并自动机：" << pattern_set->shard_count() << "个分片，共" << states << "个状态\n\n";
+    }
 
     string input_str;
     while (1) {
@@ -56,18 +216,35 @@ int main(int argc, char **argv) {
             break;
         }
 
-        regexs::deterministic_automaton::state st = dfa.start_state();
-        for (char c : input_str) {
-            st = dfa.next_state(st, c);
+        bool matched;
+        set<int> mark;
+        if (pattern_set != nullptr) {
+            mark = pattern_set->match(input_str);
+            matched = !mark.empty();
+        } else {
+            regexs::nondeterministic_automaton::state st = nfa.start_state();
+            for (char c : input_str) {
+                st.next(c);
+            }
+            matched = nfa.is_stop_state(st);
+            if (matched) mark = st.state_marks();
         }
 
-        if (dfa.is_stop_state(st)) {
-            set<int> mark = dfa.state_mark(st);
+        if (matched) {
             cout << "匹配结果：" << serialize_set(mark) << '\n';
         } else {
             cout << "无匹配项\n";
         }
     }
 
+    if (show_profile && pattern_set != nullptr) {
+        for (size_t k = 0; k < pattern_set->shard_count(); k++) {
+            const regexs::transition_table& table = pattern_set->shard_table(k);
+            if (table.profile() != nullptr) {
+                cout << k << "号分片匹配剖析：\n" << table.profile()->serialize(table);
+            }
+        }
+    }
+
     return 0;
 }
\ No newline at end of file
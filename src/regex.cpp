@@ -1,27 +1,402 @@
-
 #include "regex.hpp"
+#include "regex_compact.hpp"
+#include "regex_compile.hpp"
+#include "regex_derivative.hpp"
 #include "regex_dfa.hpp"
+#include "regex_literal.hpp"
 #include "regex_nfa.hpp"
 #include "regex_parse.hpp"
+#include "regex_shuffle.hpp"
+#include "regex_table.hpp"
+#include <chrono>
+#include <climits>
 #include <memory>
+#include <stdexcept>
 #include <string>
+#include <utility>
 
 namespace regexs {
-    regex::regex(std::string_view sv) : 
-        __tokens(regex_tokenize(sv)),
-        __atm(build_nfa(__tokens)),
-        __dfa_ptr(nullptr)
-    {}
+    static inline bool is_dead(const deterministic_automaton& atm, deterministic_automaton::state s) {
+        return s == deterministic_automaton::REJECT;
+    }
+
+    static inline bool is_dead(const nondeterministic_automaton& atm, const nondeterministic_automaton::state& s) {
+        return s.empty();
+    }
+
+    static inline bool is_dead(const transition_table& atm, transition_table::state s) {
+        return s == atm.dead_state();
+    }
+
+    static bool full_match(const transition_table& atm, std::string_view sv) {
+        return atm.is_stop_state(atm.run(atm.start_state(), sv));
+    }
+
+    static std::optional<size_t> earliest_end(const transition_table& atm, std::string_view sv) {
+        const char* p = sv.data();
+        transition_table::state s = atm.run_to_stop(atm.start_state(), p, sv.data() + sv.size());
+        if (!atm.is_stop_state(s)) return std::nullopt;
+        return p - sv.data();
+    }
+
+    template <typename Automaton>
+    static bool full_match(const Automaton& atm, std::string_view sv) {
+        auto s = atm.start_state();
+        for (char c : sv) {
+            s = atm.next_state(s, c);
+            if (is_dead(atm, s)) return false;
+        }
+        return atm.is_stop_state(s);
+    }
+
+    template <typename Automaton>
+    static std::optional<size_t> earliest_end(const Automaton& atm, std::string_view sv) {
+        auto s = atm.start_state();
+        size_t end = 0;
+        bool found = atm.is_stop_state(s);
+        while (!found && end < sv.size() && !is_dead(atm, s)) {
+            s = atm.next_state(s, sv[end++]);
+            found = atm.is_stop_state(s);
+        }
+        if (!found) return std::nullopt;
+        return end;
+    }
+
+    template <typename Automaton>
+    static size_t leftmost_start(const Automaton& atm, std::string_view sv, size_t end) {
+        auto r = atm.start_state();
+        size_t begin = end;
+        for (size_t i = end; i > 0 && !is_dead(atm, r); i--) {
+            r = atm.next_state(r, sv[i - 1]);
+            if (atm.is_stop_state(r)) {
+                begin = i - 1;
+            }
+        }
+        return begin;
+    }
+
+    // Matches any run of bytes within one line
+    static nondeterministic_automaton line_filler() {
+        nondeterministic_automaton atm;
+        for (int ch = CHAR_MIN; ch <= CHAR_MAX; ch++) {
+            if (ch != transition_table::LINE_DELIMITER) {
+                atm.add_jump(atm.start_single_state(), static_cast<char>(ch), atm.start_single_state());
+            }
+        }
+        atm.set_stop_state(atm.start_single_state());
+        return atm;
+    }
+
+    // Anchors only affect search and scan_lines, since match always covers the whole input
+    regex::regex(std::string_view sv, const compile_options& options) : 
+        __options(options),
+        __anchor_begin(false),
+        __anchor_end(false),
+        __engine(DFA),
+        __bit_parallel_bytes(0),
+        __dfa_built(false),
+        __dfa_ptr(nullptr),
+        __search_dfa_ptr(nullptr),
+        __reverse_dfa_ptr(nullptr),
+        __line_built(false)
+    {
+        pattern_anchors anchors = strip_anchors(sv);
+        __anchor_begin = anchors.begin;
+        __anchor_end = anchors.end;
+
+        auto t0 = std::chrono::steady_clock::now();
+        __tokens = regex_tokenize(sv);
+        auto t1 = std::chrono::steady_clock::now();
+        __pattern = simplify_pattern(parse_pattern(__tokens, __options.case_insensitive), __options.case_insensitive);
+        __facts = analyze_pattern(*__pattern, __options.case_insensitive);
+        __atm = pattern_automaton(*__pattern, __options.case_insensitive);
+        auto t2 = std::chrono::steady_clock::now();
+
+        __stats.tokenize_time = t1 - t0;
+        __stats.build_nfa_time = t2 - t1;
+        __stats.record_nfa(__atm);
+
+        // Approximate matching only runs on the bit-parallel engine, which it never leaves
+        if (__options.max_edits > 0) {
+            if (!bit_parallel_nfa::fits(*__pattern) || __options.max_edits > bit_parallel_nfa::MAX_EDITS) {
+                throw std::invalid_argument("approximate matching needs at most 64 pattern positions and 8 edits");
+            }
+            __bit_parallel_ptr = std::make_unique<bit_parallel_nfa>(*__pattern, __options.case_insensitive);
+            __reverse_bit_parallel_ptr = std::make_unique<bit_parallel_nfa>(*reverse_pattern(__pattern), __options.case_insensitive);
+            return;
+        }
+
+        if (!__options.profile) {
+            pick_literal_engine(__pattern);
+        }
+        if (__literal_ptr == nullptr && __literal_set_ptr == nullptr && !__options.profile
+                && __options.bit_parallel_bytes > 0 && bit_parallel_nfa::fits(*__pattern)) {
+            __bit_parallel_ptr = std::make_unique<bit_parallel_nfa>(*__pattern, __options.case_insensitive);
+            __reverse_bit_parallel_ptr = std::make_unique<bit_parallel_nfa>(*reverse_pattern(__pattern), __options.case_insensitive);
+        }
+
+        // A budgeted pattern is compiled up front so that it fails or picks its engine here
+        if (__options.has_budget() && __literal_ptr == nullptr && __literal_set_ptr == nullptr) {
+            make_dfa();
+        }
+    }
+
+    // Patterns that match only a few fixed strings, none of them empty or spanning lines,
+    // skip the automata. A single case-sensitive string is searched for directly, anything
+    // else goes through Aho-Corasick.
+    void regex::pick_literal_engine(const pattern_node::pointer& pattern) {
+        std::optional<std::vector<std::string>> words = finite_language(pattern, __options.max_literals);
+        if (!words || words->empty()) {
+            return;
+        }
+        for (auto& word : *words) {
+            if (word.empty() || word.find(transition_table::LINE_DELIMITER) != std::string::npos) {
+                return;
+            }
+        }
+
+        if (words->size() == 1 && !__options.case_insensitive) {
+            __literal_ptr = std::make_unique<literal_searcher>(std::move(words->front()));
+        } else {
+            __literal_set_ptr = std::make_unique<literal_set>(*words, __options.case_insensitive);
+        }
+    }
 
     bool regex::match(std::string_view sv) const {
+        if (__literal_ptr != nullptr) {
+            return sv == __literal_ptr->needle();
+        }
+        if (rejects(sv)) {
+            return false;
+        }
+        if (__literal_set_ptr != nullptr) {
+            return __literal_set_ptr->match(sv);
+        }
+        if (take_bit_parallel(sv.size())) {
+            return __bit_parallel_ptr->match(sv, __options.max_edits);
+        }
+
         make_dfa();
 
-        deterministic_automaton::state s = __dfa_ptr->start_state();
-        for (char c : sv) {
-            s = __dfa_ptr->next_state(s, c);
+        if (__table_ptr == nullptr) {
+            return full_match(__atm, sv);
+        }
+        if (__shuffle_ptr != nullptr) {
+            return __table_ptr->is_stop_state(__shuffle_ptr->run(__table_ptr->start_state(), sv));
+        }
+        if (__compact_ptr != nullptr) {
+            return __compact_ptr->is_stop_state(__compact_ptr->run(__compact_ptr->start_state(), sv));
+        }
+        return full_match(*__table_ptr, sv);
+    }
+
+    std::vector<bool> regex::match_batch(const std::vector<std::string_view>& inputs) const {
+        std::vector<bool> matched(inputs.size());
+        if (__literal_ptr != nullptr || __literal_set_ptr != nullptr || bit_parallel_active()) {
+            for (size_t i = 0; i < inputs.size(); i++) {
+                matched[i] = match(inputs[i]);
+            }
+            return matched;
+        }
+
+        make_dfa();
+        // Shuffle steps carry no dependent load, so interleaving inputs gains nothing
+        if (__table_ptr == nullptr || __shuffle_ptr != nullptr) {
+            for (size_t i = 0; i < inputs.size(); i++) {
+                matched[i] = match(inputs[i]);
+            }
+            return matched;
+        }
+
+        std::vector<std::string_view> admitted;
+        std::vector<size_t> positions;
+        for (size_t i = 0; i < inputs.size(); i++) {
+            if (!rejects(inputs[i])) {
+                admitted.push_back(inputs[i]);
+                positions.push_back(i);
+            }
+        }
+
+        std::vector<transition_table::state> results(admitted.size());
+        __table_ptr->run_batch(admitted.data(), admitted.size(), results.data());
+        for (size_t i = 0; i < admitted.size(); i++) {
+            matched[positions[i]] = __table_ptr->is_stop_state(results[i]);
+        }
+        return matched;
+    }
+
+    // Reports the match that ends first, and among those the one starting leftmost.
+    // The forward pass finds the end, the reverse automaton walks back to the start.
+    std::optional<std::pair<size_t, size_t>> regex::search(std::string_view sv) const {
+        // No match fits in a shorter input, and an anchored match starts or ends with it
+        if (__options.max_edits == 0 && !__facts.nullable) {
+            if (sv.size() < __facts.min_length
+                    || (__anchor_begin && !__facts.first_bytes.test(static_cast<unsigned char>(sv.front())))
+                    || (__anchor_end && !__facts.last_bytes.test(static_cast<unsigned char>(sv.back())))) {
+                return std::nullopt;
+            }
+        }
+        if (__literal_ptr != nullptr || __literal_set_ptr != nullptr) {
+            return search_literal(sv);
+        }
+        if (take_bit_parallel(sv.size())) {
+            return search_bit_parallel(sv);
+        }
+
+        if (__anchor_begin) {
+            if (__anchor_end) {
+                return match(sv) ? std::make_optional(std::make_pair<size_t, size_t>(0, sv.size())) : std::nullopt;
+            }
+
+            make_dfa();
+            std::optional<size_t> end = (__table_ptr != nullptr)
+                ? earliest_end(*__table_ptr, sv)
+                : earliest_end(__atm, sv);
+            if (!end) {
+                return std::nullopt;
+            }
+            return std::make_pair<size_t, size_t>(0, *std::move(end));
+        }
+
+        make_search_dfa();
+
+        std::optional<size_t> end;
+        if (__anchor_end) {
+            bool found = (__search_table_ptr != nullptr)
+                ? full_match(*__search_table_ptr, sv)
+                : full_match(*__search_nfa_ptr, sv);
+            if (found) end = sv.size();
+        } else {
+            end = (__search_table_ptr != nullptr)
+                ? earliest_end(*__search_table_ptr, sv)
+                : earliest_end(*__search_nfa_ptr, sv);
+        }
+        if (!end) {
+            return std::nullopt;
+        }
+
+        size_t begin = (__reverse_table_ptr != nullptr)
+            ? leftmost_start(*__reverse_table_ptr, sv, *end)
+            : leftmost_start(*__reverse_nfa_ptr, sv, *end);
+
+        return std::make_pair(begin, *end);
+    }
+
+    // All matches of a literal pattern have fixed lengths, so the end found by the literal
+    // engine also fixes the leftmost start
+    std::optional<std::pair<size_t, size_t>> regex::search_literal(std::string_view sv) const {
+        if (__anchor_begin && __anchor_end) {
+            return match(sv) ? std::make_optional(std::make_pair<size_t, size_t>(0, sv.size())) : std::nullopt;
+        }
+
+        if (__literal_ptr != nullptr) {
+            const std::string& needle = __literal_ptr->needle();
+            size_t begin;
+            if (__anchor_begin) {
+                begin = (sv.substr(0, needle.size()) == needle) ? 0 : std::string_view::npos;
+            } else if (__anchor_end) {
+                begin = (sv.size() >= needle.size() && sv.substr(sv.size() - needle.size()) == needle)
+                    ? sv.size() - needle.size()
+                    : std::string_view::npos;
+            } else {
+                begin = __literal_ptr->find(sv);
+            }
+            if (begin == std::string_view::npos) {
+                return std::nullopt;
+            }
+            return std::make_pair(begin, begin + needle.size());
+        }
+
+        if (__anchor_begin) {
+            std::optional<size_t> end = __literal_set_ptr->prefix(sv);
+            if (!end) {
+                return std::nullopt;
+            }
+            return std::make_pair<size_t, size_t>(0, *std::move(end));
+        }
+        if (__anchor_end) {
+            size_t len = __literal_set_ptr->longest_suffix(sv);
+            if (len == 0) {
+                return std::nullopt;
+            }
+            return std::make_pair(sv.size() - len, sv.size());
+        }
+        return __literal_set_ptr->search(sv);
+    }
+
+    // Same passes as the automata: forward to the earliest end, then the reversed
+    // pattern back to the leftmost start
+    std::optional<std::pair<size_t, size_t>> regex::search_bit_parallel(std::string_view sv) const {
+        if (__anchor_begin && __anchor_end) {
+            return __bit_parallel_ptr->match(sv, __options.max_edits) ? std::make_optional(std::make_pair<size_t, size_t>(0, sv.size())) : std::nullopt;
+        }
+
+        std::optional<size_t> end;
+        if (__anchor_end) {
+            if (__bit_parallel_ptr->matches_suffix(sv, __options.max_edits)) end = sv.size();
+        } else {
+            end = __bit_parallel_ptr->earliest_end(sv, __anchor_begin, __options.max_edits);
+        }
+        if (!end) {
+            return std::nullopt;
+        }
+
+        size_t begin = __anchor_begin ? 0 : __reverse_bit_parallel_ptr->leftmost_start(sv, *end, __options.max_edits);
+        return std::make_pair(begin, *end);
+    }
+
+    // The bit-parallel engine takes inputs until it has seen bit_parallel_bytes, by which
+    // point the pattern has earned its DFA. Approximate patterns keep it for good.
+    bool regex::bit_parallel_active() const {
+        return __bit_parallel_ptr != nullptr
+            && (__options.max_edits > 0 || __bit_parallel_bytes < __options.bit_parallel_bytes);
+    }
+
+    bool regex::take_bit_parallel(size_t bytes) const {
+        if (!bit_parallel_active()) {
+            return false;
+        }
+        __bit_parallel_bytes += bytes;
+        return true;
+    }
+
+    // Reports every line of the buffer that contains a match, in one pass over the
+    // buffer: the line table restarts by itself after each delimiter.
+    void regex::scan_lines(std::string_view buffer, const transition_table::line_callback& on_line) const {
+        if (!__anchor_begin && !__anchor_end) {
+            if (__literal_ptr != nullptr) {
+                __literal_ptr->scan_lines(buffer, on_line);
+                return;
+            }
+            if (__literal_set_ptr != nullptr) {
+                __literal_set_ptr->scan_lines(buffer, on_line);
+                return;
+            }
+        }
+
+        if (take_bit_parallel(buffer.size())) {
+            __bit_parallel_ptr->scan_lines(buffer, on_line, __anchor_begin, __anchor_end, __options.max_edits);
+            return;
+        }
+
+        make_line_table();
+
+        if (__line_table_ptr != nullptr) {
+            __line_table_ptr->scan_lines(buffer, on_line);
+            return;
+        }
+
+        size_t line_begin = 0;
+        while (line_begin < buffer.size()) {
+            size_t line_end = buffer.find(transition_table::LINE_DELIMITER, line_begin);
+            if (line_end == std::string_view::npos) {
+                line_end = buffer.size();
+            }
+            if (search(buffer.substr(line_begin, line_end - line_begin))) {
+                on_line(line_begin, line_end);
+            }
+            line_begin = line_end + 1;
         }
-        
-        return __dfa_ptr->is_stop_state(s);
     }
 
     std::vector<std::string> regex::tokens() const {
@@ -40,18 +415,172 @@ namespace regexs {
         return __atm;
     }
 
+    // Matches are reported at every end offset. Unless the pattern starts with '^' they
+    // may begin anywhere in the stream, so the unanchored search table is used.
+    stream_matcher regex::stream(stream_matcher::match_callback on_match) const {
+        if (__options.max_edits > 0) {
+            throw std::logic_error("streaming does not support approximate matching");
+        }
+        const transition_table* tbl;
+        if (__anchor_begin) {
+            make_dfa();
+            tbl = __table_ptr.get();
+        } else {
+            make_search_dfa();
+            tbl = __search_table_ptr.get();
+        }
+        if (tbl == nullptr) {
+            throw budget_exceeded("streaming needs a DFA, which exceeded the compile budget");
+        }
+        return stream_matcher(*tbl, std::move(on_match), __anchor_end);
+    }
+
     const deterministic_automaton& regex::deter_automaton() const {
         make_dfa();
+        if (__dfa_ptr == nullptr) {
+            throw budget_exceeded("DFA was not built because it exceeded the compile budget");
+        }
         return *__dfa_ptr;
     }
 
+    const deterministic_automaton& regex::reverse_automaton() const {
+        make_search_dfa();
+        if (__reverse_dfa_ptr == nullptr) {
+            throw budget_exceeded("reverse DFA was not built because it exceeded the compile budget");
+        }
+        return *__reverse_dfa_ptr;
+    }
+
+    const compile_stats& regex::stats() const {
+        make_dfa();
+        return __stats;
+    }
+
+    const pattern_facts& regex::facts() const {
+        return __facts;
+    }
+
+    regex::engine_type regex::engine() const {
+        if (__literal_ptr != nullptr || __literal_set_ptr != nullptr) {
+            return LITERAL;
+        }
+        if (__options.max_edits > 0) {
+            return APPROXIMATE;
+        }
+        if (bit_parallel_active()) {
+            return BIT_PARALLEL;
+        }
+        make_dfa();
+        return __engine;
+    }
+
+    std::string regex::profile_report() const {
+        std::string report;
+        auto add = [&](const char* name, const std::unique_ptr<transition_table>& tbl) {
+            if (tbl != nullptr && tbl->profile() != nullptr) {
+                report += std::string(name) + ":\n" + tbl->profile()->serialize(*tbl);
+            }
+        };
+        add("MATCH_TABLE", __table_ptr);
+        add("SEARCH_TABLE", __search_table_ptr);
+        add("REVERSE_TABLE", __reverse_table_ptr);
+        add("LINE_TABLE", __line_table_ptr);
+
+        // Input the tables never saw, so that the counts above are not taken for all of it
+        if (__literal_ptr != nullptr || __literal_set_ptr != nullptr) {
+            report += "UNPROFILED = LITERAL_ENGINE\n";
+        }
+        if (__bit_parallel_bytes > 0) {
+            report += "UNPROFILED_BIT_PARALLEL_BYTES = " + std::to_string(__bit_parallel_bytes) + "\n";
+        }
+        if (__shuffle_ptr != nullptr || __compact_ptr != nullptr) {
+            report += std::string("UNPROFILED_MATCH = ") + (__shuffle_ptr != nullptr ? "SHUFFLE_TABLE" : "COMPACT_TABLE") + "\n";
+        }
+        return report;
+    }
+
     void regex::make_dfa() const {
-        if (__dfa_ptr == nullptr) {
-            __dfa_ptr = std::make_unique<deterministic_automaton>(__atm.to_deterministic());
+        if (!__dfa_built) {
+            __dfa_ptr = __options.derivatives ? try_derive(&__stats) : try_compile(__atm, &__stats);
+            if (__dfa_ptr != nullptr) {
+                __table_ptr = std::make_unique<transition_table>(*__dfa_ptr);
+                if (__options.profile) {
+                    // Only the plain table loops are counted
+                } else if (shuffle_table::fits(*__table_ptr)) {
+                    __shuffle_ptr = std::make_unique<shuffle_table>(*__table_ptr);
+                } else if (compact_table::worth_compacting(*__table_ptr)) {
+                    __compact_ptr = std::make_unique<compact_table>(*__table_ptr);
+                }
+            }
+            __engine = (__dfa_ptr != nullptr) ? DFA : NFA;
+            __dfa_built = true;
+        }
+    }
+
+    void regex::make_search_dfa() const {
+        if (__search_dfa_ptr == nullptr && __search_nfa_ptr == nullptr) {
+            nondeterministic_automaton unanchored = __atm;
+            unanchored.refactor_to_unanchored();
+            nondeterministic_automaton reversed = __atm.reverse();
+
+            __search_dfa_ptr = try_compile(unanchored, nullptr);
+            __reverse_dfa_ptr = try_compile(reversed, nullptr);
+            if (__search_dfa_ptr != nullptr) {
+                __search_table_ptr = std::make_unique<transition_table>(*__search_dfa_ptr);
+            } else {
+                __search_nfa_ptr = std::make_unique<nondeterministic_automaton>(std::move(unanchored));
+            }
+            if (__reverse_dfa_ptr != nullptr) {
+                __reverse_table_ptr = std::make_unique<transition_table>(*__reverse_dfa_ptr);
+            } else {
+                __reverse_nfa_ptr = std::make_unique<nondeterministic_automaton>(std::move(reversed));
+            }
+        }
+    }
+
+    void regex::make_line_table() const {
+        if (!__line_built) {
+            nondeterministic_automaton line_atm = __anchor_begin ? __atm : line_filler();
+            if (!__anchor_begin) {
+                line_atm.connect(__atm);
+            }
+            if (!__anchor_end) {
+                line_atm.connect(line_filler());
+            }
+
+            std::unique_ptr<deterministic_automaton> line_dfa = try_compile(line_atm, nullptr);
+            if (line_dfa != nullptr) {
+                __line_table_ptr = std::make_unique<transition_table>(*line_dfa, true);
+            }
+            __line_built = true;
+        }
+    }
+
+    // Returns nullptr when the budget is exceeded and the options allow falling back
+    // to simulating the NFA.
+    std::unique_ptr<deterministic_automaton> regex::try_compile(const nondeterministic_automaton& nfa, compile_stats* stats) const {
+        try {
+            return std::make_unique<deterministic_automaton>(compile_dfa(nfa, __options, stats));
+        } catch (const budget_exceeded&) {
+            if (__options.on_budget_exceeded == compile_options::FAIL) {
+                throw;
+            }
+            return nullptr;
+        }
+    }
+
+    std::unique_ptr<deterministic_automaton> regex::try_derive(compile_stats* stats) const {
+        try {
+            return std::make_unique<deterministic_automaton>(derivative_dfa(*__pattern, __options, stats));
+        } catch (const budget_exceeded&) {
+            if (__options.on_budget_exceeded == compile_options::FAIL) {
+                throw;
+            }
+            return nullptr;
         }
     }
 
     regex literal::operator"" _regex(const char* str, size_t len) {
         return regex(std::string_view(str, len));
     }
-}
\ No newline at end of file
+}
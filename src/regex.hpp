@@ -2,29 +2,92 @@
 #define REGEX_HPP
 
 #include <memory>
+#include <optional>
+#include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 
+#include "regex_ast.hpp"
+#include "regex_bitparallel.hpp"
+#include "regex_compact.hpp"
+#include "regex_compile.hpp"
 #include "regex_dfa.hpp"
+#include "regex_literal.hpp"
 #include "regex_nfa.hpp"
 #include "regex_parse.hpp"
+#include "regex_shuffle.hpp"
+#include "regex_stream.hpp"
+#include "regex_table.hpp"
 
 namespace regexs {
     class regex {
     public:
-        regex(std::string_view sv);
+        enum engine_type {
+            DFA, NFA, LITERAL, BIT_PARALLEL, APPROXIMATE
+        };
+
+        regex(std::string_view sv, const compile_options& options = {});
 
         bool match(std::string_view sv) const;
+        std::vector<bool> match_batch(const std::vector<std::string_view>& inputs) const;
+        std::optional<std::pair<size_t, size_t>> search(std::string_view sv) const;
+        void scan_lines(std::string_view buffer, const transition_table::line_callback& on_line) const;
+        stream_matcher stream(stream_matcher::match_callback on_match) const;
         std::vector<std::string> tokens() const;
         nondeterministic_automaton& automaton();
         const nondeterministic_automaton& automaton() const;
         const deterministic_automaton& deter_automaton() const;
+        const deterministic_automaton& reverse_automaton() const;
+        const compile_stats& stats() const;
+        // What every match of the pattern looks like; approximate patterns do not obey it
+        const pattern_facts& facts() const;
+        engine_type engine() const;
+        // Profiles of the tables built so far, empty unless built with REGEX_PROFILE
+        std::string profile_report() const;
     private:
         std::vector<std::shared_ptr<token>> __tokens;
         nondeterministic_automaton __atm;
+        pattern_node::pointer __pattern;
+        pattern_facts __facts;
+        compile_options __options;
+        bool __anchor_begin;
+        bool __anchor_end;
+        mutable engine_type __engine;
+        std::unique_ptr<literal_searcher> __literal_ptr;
+        std::unique_ptr<literal_set> __literal_set_ptr;
+        std::unique_ptr<bit_parallel_nfa> __bit_parallel_ptr;
+        std::unique_ptr<bit_parallel_nfa> __reverse_bit_parallel_ptr;
+        mutable size_t __bit_parallel_bytes;
+        mutable bool __dfa_built;
         mutable std::unique_ptr<deterministic_automaton> __dfa_ptr;
+        mutable std::unique_ptr<deterministic_automaton> __search_dfa_ptr;
+        mutable std::unique_ptr<deterministic_automaton> __reverse_dfa_ptr;
+        mutable std::unique_ptr<nondeterministic_automaton> __search_nfa_ptr;
+        mutable std::unique_ptr<nondeterministic_automaton> __reverse_nfa_ptr;
+        mutable std::unique_ptr<transition_table> __table_ptr;
+        mutable std::unique_ptr<compact_table> __compact_ptr;
+        mutable std::unique_ptr<shuffle_table> __shuffle_ptr;
+        mutable std::unique_ptr<transition_table> __search_table_ptr;
+        mutable std::unique_ptr<transition_table> __reverse_table_ptr;
+        mutable std::unique_ptr<transition_table> __line_table_ptr;
+        mutable bool __line_built;
+        mutable compile_stats __stats;
 
+        void pick_literal_engine(const pattern_node::pointer& pattern);
+        std::optional<std::pair<size_t, size_t>> search_literal(std::string_view sv) const;
+        std::optional<std::pair<size_t, size_t>> search_bit_parallel(std::string_view sv) const;
+        bool bit_parallel_active() const;
+        // Inputs the facts rule out, checked before any automaton runs
+        inline bool rejects(std::string_view sv) const {
+            return __options.max_edits == 0 && !__facts.admits(sv);
+        }
+        bool take_bit_parallel(size_t bytes) const;
         void make_dfa() const;
+        void make_search_dfa() const;
+        void make_line_table() const;
+        std::unique_ptr<deterministic_automaton> try_compile(const nondeterministic_automaton& nfa, compile_stats* stats) const;
+        std::unique_ptr<deterministic_automaton> try_derive(compile_stats* stats) const;
     };
 
     namespace literal {
@@ -34,4 +97,4 @@ namespace regexs {
     using namespace literal;
 }
 
-#endif
\ No newline at end of file
+#endif
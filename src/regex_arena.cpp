@@ -0,0 +1,22 @@
+#include "regex_arena.hpp"
+
+using namespace regexs;
+
+static thread_local std::pmr::memory_resource* current_resource = nullptr;
+
+compile_arena::compile_arena() :
+    __blocks(INITIAL_BLOCK),
+    __pool(&__blocks)
+{}
+
+std::pmr::memory_resource* compile_arena::current() {
+    return (current_resource != nullptr) ? current_resource : std::pmr::get_default_resource();
+}
+
+compile_arena::scope::scope(compile_arena& arena) : __previous(current_resource) {
+    current_resource = arena.resource();
+}
+
+compile_arena::scope::~scope() {
+    current_resource = __previous;
+}
@@ -0,0 +1,44 @@
+#ifndef REGEX_ARENA_HPP
+#define REGEX_ARENA_HPP
+
+#include <cstddef>
+#include <memory_resource>
+
+namespace regexs {
+    // Memory for compile temporaries. While a scope is open on a thread, NFA subsets built
+    // on that thread allocate from the arena: freed nodes are recycled through a pool, and
+    // everything is released in one go when the arena is destroyed. Nothing allocated
+    // inside a scope may outlive its arena.
+    //
+    // An arena is not thread-safe; give every worker thread its own.
+    class compile_arena {
+    public:
+        class scope {
+        public:
+            explicit scope(compile_arena& arena);
+            ~scope();
+
+            scope(const scope&) = delete;
+            scope& operator=(const scope&) = delete;
+        private:
+            std::pmr::memory_resource* __previous;
+        };
+
+        static constexpr size_t INITIAL_BLOCK = 64 * 1024;
+
+        compile_arena();
+
+        compile_arena(const compile_arena&) = delete;
+        compile_arena& operator=(const compile_arena&) = delete;
+
+        inline std::pmr::memory_resource* resource() { return &__pool; }
+
+        // The arena of the innermost open scope on this thread, or the default resource
+        static std::pmr::memory_resource* current();
+    private:
+        std::pmr::monotonic_buffer_resource __blocks;
+        std::pmr::unsynchronized_pool_resource __pool;
+    };
+}
+
+#endif
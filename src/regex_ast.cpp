@@ -0,0 +1,567 @@
+#include "regex_ast.hpp"
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
+#include <utility>
+
+using namespace regexs;
+using pointer = pattern_node::pointer;
+
+pointer pattern_node::empty() {
+    static const pointer empty_node(new pattern_node(EMPTY));
+    return empty_node;
+}
+
+pointer pattern_node::literal(std::string text) {
+    if (text.empty()) {
+        return empty();
+    }
+    auto node = new pattern_node(LITERAL);
+    node->__text = std::move(text);
+    return pointer(node);
+}
+
+pointer pattern_node::char_class(const char_set& chars) {
+    auto node = new pattern_node(CLASS);
+    node->__chars = chars;
+    return pointer(node);
+}
+
+pointer pattern_node::concat(std::vector<pointer> children) {
+    auto node = new pattern_node(CONCAT);
+    node->__children = std::move(children);
+    return pointer(node);
+}
+
+pointer pattern_node::alternate(std::vector<pointer> children) {
+    auto node = new pattern_node(ALTERNATE);
+    node->__children = std::move(children);
+    return pointer(node);
+}
+
+pointer pattern_node::repeat(kind op, pointer child) {
+    auto node = new pattern_node(op);
+    node->__children = {std::move(child)};
+    return pointer(node);
+}
+
+size_t pattern_node::size() const {
+    size_t total = 1 + __text.size();
+    for (auto& child : __children) {
+        total += child->size();
+    }
+    return total;
+}
+
+// Also serves as the identity of a node: equal strings mean equal trees
+std::string pattern_node::serialize() const {
+    std::stringstream seri_stream;
+    switch (__kind) {
+    case EMPTY:
+        seri_stream << "()";
+        break;
+    case LITERAL:
+        seri_stream << '"';
+        for (char c : __text) {
+            if (c == '"' || c == '\\') seri_stream << '\\';
+            seri_stream << c;
+        }
+        seri_stream << '"';
+        break;
+    case CLASS:
+        seri_stream << '[' << std::hex;
+        for (int b = 0; b < 256; b++) {
+            if (!__chars[b]) continue;
+            int e = b;
+            while (e + 1 < 256 && __chars[e + 1]) e++;
+            seri_stream << b;
+            if (e != b) seri_stream << '-' << e;
+            seri_stream << ',';
+            b = e;
+        }
+        seri_stream << ']';
+        break;
+    case CONCAT:
+    case ALTERNATE:
+        seri_stream << (__kind == CONCAT ? "C(" : "A(");
+        for (size_t i = 0; i < __children.size(); i++) {
+            if (i) seri_stream << ',';
+            seri_stream << __children[i]->serialize();
+        }
+        seri_stream << ')';
+        break;
+    case STAR:
+    case PLUS:
+    case OPTIONAL:
+        seri_stream << (__kind == STAR ? '*' : __kind == PLUS ? '+' : '?') << '(' << __children[0]->serialize() << ')';
+        break;
+    }
+    return seri_stream.str();
+}
+
+static bool is_repeat(const pointer& node) {
+    auto k = node->node_kind();
+    return k == pattern_node::STAR || k == pattern_node::PLUS || k == pattern_node::OPTIONAL;
+}
+
+static bool is_single_char(const pointer& node) {
+    return node->node_kind() == pattern_node::CLASS
+        || (node->node_kind() == pattern_node::LITERAL && node->text().size() == 1);
+}
+
+static pattern_node::char_set byte_chars(char byte, bool case_insensitive) {
+    pattern_node::char_set chars;
+    unsigned char c = static_cast<unsigned char>(byte);
+    chars[c] = true;
+    if (case_insensitive && c >= 'a' && c <= 'z') chars[c - 'a' + 'A'] = true;
+    if (case_insensitive && c >= 'A' && c <= 'Z') chars[c - 'A' + 'a'] = true;
+    return chars;
+}
+
+static pattern_node::char_set chars_of(const pointer& node, bool case_insensitive) {
+    if (node->node_kind() == pattern_node::CLASS) {
+        return node->chars();
+    }
+    return byte_chars(node->text()[0], case_insensitive);
+}
+
+// A concatenation as a flat list: nested concatenations are opened and literals are
+// split into single characters
+static std::vector<pointer> atoms_of(const pointer& node) {
+    std::vector<pointer> atoms;
+    if (node->node_kind() == pattern_node::CONCAT) {
+        for (auto& child : node->children()) {
+            auto child_atoms = atoms_of(child);
+            atoms.insert(atoms.end(), child_atoms.begin(), child_atoms.end());
+        }
+    } else if (node->node_kind() == pattern_node::LITERAL) {
+        for (char c : node->text()) {
+            atoms.push_back(pattern_node::literal(std::string(1, c)));
+        }
+    } else if (node->node_kind() != pattern_node::EMPTY) {
+        atoms.push_back(node);
+    }
+    return atoms;
+}
+
+// Rebuilds a concatenation from atoms, joining adjacent literals and collapsing x*x* into x*
+static pointer join(const std::vector<pointer>& atoms) {
+    std::vector<pointer> children;
+    for (auto& atom : atoms) {
+        for (auto& a : atoms_of(atom)) {
+            if (!children.empty()) {
+                const pointer& last = children.back();
+                if (last->node_kind() == pattern_node::LITERAL && a->node_kind() == pattern_node::LITERAL) {
+                    children.back() = pattern_node::literal(last->text() + a->text());
+                    continue;
+                }
+                if (last->node_kind() == pattern_node::STAR && a->node_kind() == pattern_node::STAR
+                    && last->serialize() == a->serialize()) {
+                    continue;
+                }
+            }
+            children.push_back(a);
+        }
+    }
+
+    if (children.empty()) return pattern_node::empty();
+    if (children.size() == 1) return children[0];
+    return pattern_node::concat(std::move(children));
+}
+
+static pointer make_repeat(pattern_node::kind op, pointer child, bool case_insensitive);
+
+// A sequence made of one alternation is opened into its branches, so that alternations
+// factored at an inner level can be grouped again with their neighbours
+static void add_sequence(std::vector<std::vector<pointer>>& seqs, std::vector<pointer> seq, bool& has_empty) {
+    if (seq.size() == 1 && seq[0]->node_kind() == pattern_node::OPTIONAL) {
+        has_empty = true;
+        seq = atoms_of(seq[0]->children()[0]);
+    }
+    if (seq.size() == 1 && seq[0]->node_kind() == pattern_node::ALTERNATE) {
+        for (auto& branch : seq[0]->children()) {
+            add_sequence(seqs, atoms_of(branch), has_empty);
+        }
+        return;
+    }
+    if (seq.empty()) {
+        has_empty = true;
+        return;
+    }
+    seqs.push_back(std::move(seq));
+}
+
+// Groups branches by their first atom, then by their last, and merges single characters
+// into one class. An empty branch makes the whole alternation optional.
+static pointer factor(std::vector<std::vector<pointer>> seqs, bool has_empty, bool case_insensitive) {
+    std::vector<std::vector<pointer>> opened;
+    for (auto& seq : seqs) {
+        add_sequence(opened, std::move(seq), has_empty);
+    }
+
+    std::vector<std::pair<std::string, std::vector<std::vector<pointer>>>> groups;
+    std::map<std::string, size_t> group_index;
+    for (auto& seq : opened) {
+        std::string key = seq.front()->serialize();
+        auto [it, inserted] = group_index.emplace(key, groups.size());
+        if (inserted) {
+            groups.emplace_back(key, std::vector<std::vector<pointer>>());
+        }
+        groups[it->second].second.push_back(std::move(seq));
+    }
+
+    std::vector<std::vector<pointer>> branches;
+    for (auto& [key, members] : groups) {
+        if (members.size() == 1) {
+            branches.push_back(std::move(members[0]));
+            continue;
+        }
+        pointer head = members[0].front();
+        std::vector<std::vector<pointer>> rests;
+        for (auto& seq : members) {
+            rests.emplace_back(seq.begin() + 1, seq.end());
+        }
+        branches.push_back({head, factor(std::move(rests), false, case_insensitive)});
+    }
+
+    std::vector<std::pair<std::string, std::vector<std::vector<pointer>>>> tails;
+    std::map<std::string, size_t> tail_index;
+    for (auto& seq : branches) {
+        std::string key = seq.back()->serialize();
+        auto [it, inserted] = tail_index.emplace(key, tails.size());
+        if (inserted) {
+            tails.emplace_back(key, std::vector<std::vector<pointer>>());
+        }
+        tails[it->second].second.push_back(std::move(seq));
+    }
+
+    std::vector<pointer> alternatives;
+    for (auto& [key, members] : tails) {
+        if (members.size() == 1) {
+            alternatives.push_back(join(members[0]));
+            continue;
+        }
+        pointer tail = members[0].back();
+        std::vector<std::vector<pointer>> fronts;
+        for (auto& seq : members) {
+            fronts.emplace_back(seq.begin(), seq.end() - 1);
+        }
+        alternatives.push_back(join({factor(std::move(fronts), false, case_insensitive), tail}));
+    }
+
+    std::vector<pointer> merged;
+    pattern_node::char_set chars;
+    size_t class_position = alternatives.size();
+    std::set<std::string> seen;
+    for (auto& alt : alternatives) {
+        if (is_single_char(alt)) {
+            if (class_position == alternatives.size()) class_position = merged.size();
+            chars |= chars_of(alt, case_insensitive);
+        } else if (seen.insert(alt->serialize()).second) {
+            merged.push_back(alt);
+        }
+    }
+    if (class_position != alternatives.size()) {
+        pointer cls = pattern_node::char_class(chars);
+        if (chars.count() == 1 && !case_insensitive) {
+            int b = 0;
+            while (!chars[b]) b++;
+            cls = pattern_node::literal(std::string(1, static_cast<char>(b)));
+        }
+        merged.insert(merged.begin() + class_position, cls);
+    }
+
+    pointer result = merged.empty() ? pattern_node::empty()
+                   : merged.size() == 1 ? merged[0]
+                   : pattern_node::alternate(std::move(merged));
+    return has_empty ? make_repeat(pattern_node::OPTIONAL, result, case_insensitive) : result;
+}
+
+static pointer factor_branches(const std::vector<pointer>& branches, bool case_insensitive) {
+    std::vector<std::vector<pointer>> seqs;
+    std::set<std::string> seen;
+    for (auto& branch : branches) {
+        if (seen.insert(branch->serialize()).second) {
+            seqs.push_back(atoms_of(branch));
+        }
+    }
+    return factor(std::move(seqs), false, case_insensitive);
+}
+
+// Nested repetitions of one kind collapse into it, and mixed kinds into a star. Under a
+// star, repetitions inside an alternation are redundant, and a concatenation of starred
+// or optional parts is the star of their alternation: (a*|b)* = (a*b?)* = (a|b)*.
+static pointer make_repeat(pattern_node::kind op, pointer child, bool case_insensitive) {
+    if (child->node_kind() == pattern_node::EMPTY) {
+        return child;
+    }
+    if (is_repeat(child)) {
+        if (child->node_kind() == op) return child;
+        return make_repeat(pattern_node::STAR, child->children()[0], case_insensitive);
+    }
+
+    if (op == pattern_node::STAR) {
+        std::vector<pointer> inner;
+        bool changed = false;
+        if (child->node_kind() == pattern_node::ALTERNATE) {
+            for (auto& alt : child->children()) {
+                changed |= is_repeat(alt);
+                inner.push_back(is_repeat(alt) ? alt->children()[0] : alt);
+            }
+        } else if (child->node_kind() == pattern_node::CONCAT) {
+            changed = true;
+            for (auto& part : child->children()) {
+                auto k = part->node_kind();
+                if (k != pattern_node::STAR && k != pattern_node::OPTIONAL) {
+                    changed = false;
+                    break;
+                }
+                inner.push_back(part->children()[0]);
+            }
+        }
+        if (changed) {
+            return make_repeat(pattern_node::STAR, factor_branches(inner, case_insensitive), case_insensitive);
+        }
+    }
+
+    return pattern_node::repeat(op, std::move(child));
+}
+
+// Parsed alternations and concatenations nest one operand per level; they are opened
+// into one list first so that long chains are factored once rather than at every level
+static void collect(const pointer& node, pattern_node::kind k, std::vector<pointer>& out) {
+    if (node->node_kind() == k) {
+        for (auto& child : node->children()) {
+            collect(child, k, out);
+        }
+    } else {
+        out.push_back(node);
+    }
+}
+
+pointer regexs::simplify_pattern(const pointer& node, bool case_insensitive) {
+    switch (node->node_kind()) {
+    case pattern_node::EMPTY:
+    case pattern_node::LITERAL:
+    case pattern_node::CLASS:
+        return node;
+    case pattern_node::CONCAT:
+        {
+            std::vector<pointer> parts, children;
+            collect(node, pattern_node::CONCAT, parts);
+            for (auto& part : parts) {
+                children.push_back(simplify_pattern(part, case_insensitive));
+            }
+            return join(children);
+        }
+    case pattern_node::ALTERNATE:
+        {
+            std::vector<pointer> alternatives, branches;
+            collect(node, pattern_node::ALTERNATE, alternatives);
+            for (auto& child : alternatives) {
+                pointer simplified = simplify_pattern(child, case_insensitive);
+                if (simplified->node_kind() == pattern_node::ALTERNATE) {
+                    branches.insert(branches.end(), simplified->children().begin(), simplified->children().end());
+                } else {
+                    branches.push_back(simplified);
+                }
+            }
+            return factor_branches(branches, case_insensitive);
+        }
+    case pattern_node::STAR:
+    case pattern_node::PLUS:
+    case pattern_node::OPTIONAL:
+        return make_repeat(node->node_kind(), simplify_pattern(node->children()[0], case_insensitive), case_insensitive);
+    }
+    return node;
+}
+
+pointer regexs::reverse_pattern(const pointer& node) {
+    switch (node->node_kind()) {
+    case pattern_node::LITERAL:
+        return pattern_node::literal(std::string(node->text().rbegin(), node->text().rend()));
+    case pattern_node::CONCAT:
+        {
+            std::vector<pointer> children;
+            for (auto it = node->children().rbegin(); it != node->children().rend(); ++it) {
+                children.push_back(reverse_pattern(*it));
+            }
+            return pattern_node::concat(std::move(children));
+        }
+    case pattern_node::ALTERNATE:
+        {
+            std::vector<pointer> children;
+            for (auto& child : node->children()) {
+                children.push_back(reverse_pattern(child));
+            }
+            return pattern_node::alternate(std::move(children));
+        }
+    case pattern_node::STAR:
+    case pattern_node::PLUS:
+    case pattern_node::OPTIONAL:
+        return pattern_node::repeat(node->node_kind(), reverse_pattern(node->children()[0]));
+    default:
+        return node;
+    }
+}
+
+static bool expand(const pointer& node, size_t limit, std::vector<std::string>& out) {
+    switch (node->node_kind()) {
+    case pattern_node::EMPTY:
+        out = {""};
+        return true;
+    case pattern_node::LITERAL:
+        out = {node->text()};
+        return true;
+    case pattern_node::CLASS:
+        if (node->chars().count() > limit) return false;
+        out.clear();
+        for (size_t c = 0; c < 256; c++) {
+            if (node->chars().test(c)) out.push_back(std::string(1, static_cast<char>(c)));
+        }
+        return true;
+    case pattern_node::CONCAT:
+        out = {""};
+        for (auto& child : node->children()) {
+            std::vector<std::string> tails, joined;
+            if (!expand(child, limit, tails) || out.size() * tails.size() > limit) return false;
+            for (auto& head : out) {
+                for (auto& tail : tails) joined.push_back(head + tail);
+            }
+            out = std::move(joined);
+        }
+        return true;
+    case pattern_node::ALTERNATE:
+    case pattern_node::OPTIONAL:
+        out.clear();
+        if (node->node_kind() == pattern_node::OPTIONAL) out.push_back("");
+        for (auto& child : node->children()) {
+            std::vector<std::string> branch;
+            if (!expand(child, limit, branch) || out.size() + branch.size() > limit) return false;
+            out.insert(out.end(), branch.begin(), branch.end());
+        }
+        return true;
+    default:
+        return false;
+    }
+}
+
+std::optional<std::vector<std::string>> regexs::finite_language(const pointer& node, size_t limit) {
+    std::vector<std::string> words;
+    if (!expand(node, limit, words)) {
+        return std::nullopt;
+    }
+    std::sort(words.begin(), words.end());
+    words.erase(std::unique(words.begin(), words.end()), words.end());
+    return words;
+}
+
+void pattern_facts::merge(const pattern_facts& other) {
+    min_length = std::min(min_length, other.min_length);
+    max_length = std::max(max_length, other.max_length);
+    first_bytes |= other.first_bytes;
+    last_bytes |= other.last_bytes;
+    nullable = nullable || other.nullable;
+}
+
+std::string pattern_facts::serialize() const {
+    std::stringstream seri_stream;
+    seri_stream << "MIN_LENGTH = " << min_length << '\n'
+                << "MAX_LENGTH = ";
+    if (max_length == UNBOUNDED) {
+        seri_stream << "UNBOUNDED";
+    } else {
+        seri_stream << max_length;
+    }
+    seri_stream << '\n'
+                << "FIRST_BYTES = " << first_bytes.count() << '\n'
+                << "LAST_BYTES = " << last_bytes.count() << '\n'
+                << "NULLABLE = " << nullable << '\n';
+    return seri_stream.str();
+}
+
+static size_t add_lengths(size_t a, size_t b) {
+    return (a > pattern_facts::UNBOUNDED - b) ? pattern_facts::UNBOUNDED : a + b;
+}
+
+static bool matches_nothing(const pattern_facts& facts) {
+    return !facts.nullable && facts.min_length > facts.max_length;
+}
+
+static pattern_facts empty_facts() {
+    pattern_facts facts;
+    facts.min_length = 0;
+    facts.nullable = true;
+    return facts;
+}
+
+static pattern_facts concat_facts(const pattern_facts& a, const pattern_facts& b) {
+    if (matches_nothing(a) || matches_nothing(b)) {
+        return pattern_facts();
+    }
+    pattern_facts facts;
+    facts.min_length = add_lengths(a.min_length, b.min_length);
+    facts.max_length = add_lengths(a.max_length, b.max_length);
+    facts.first_bytes = a.nullable ? (a.first_bytes | b.first_bytes) : a.first_bytes;
+    facts.last_bytes = b.nullable ? (a.last_bytes | b.last_bytes) : b.last_bytes;
+    facts.nullable = a.nullable && b.nullable;
+    return facts;
+}
+
+pattern_facts regexs::analyze_pattern(const pattern_node& node, bool case_insensitive) {
+    switch (node.node_kind()) {
+    case pattern_node::EMPTY:
+        return empty_facts();
+    case pattern_node::LITERAL:
+        {
+            pattern_facts facts;
+            facts.min_length = facts.max_length = node.text().size();
+            facts.first_bytes = byte_chars(node.text().front(), case_insensitive);
+            facts.last_bytes = byte_chars(node.text().back(), case_insensitive);
+            return facts;
+        }
+    case pattern_node::CLASS:
+        {
+            pattern_facts facts;
+            if (node.chars().any()) {
+                facts.min_length = facts.max_length = 1;
+                facts.first_bytes = facts.last_bytes = node.chars();
+            }
+            return facts;
+        }
+    case pattern_node::CONCAT:
+        {
+            pattern_facts facts = empty_facts();
+            for (auto& child : node.children()) {
+                facts = concat_facts(facts, analyze_pattern(*child, case_insensitive));
+            }
+            return facts;
+        }
+    case pattern_node::ALTERNATE:
+        {
+            pattern_facts facts;
+            for (auto& child : node.children()) {
+                facts.merge(analyze_pattern(*child, case_insensitive));
+            }
+            return facts;
+        }
+    case pattern_node::STAR:
+    case pattern_node::PLUS:
+    case pattern_node::OPTIONAL:
+        {
+            pattern_facts facts = analyze_pattern(*node.children()[0], case_insensitive);
+            if (matches_nothing(facts)) {
+                return (node.node_kind() == pattern_node::PLUS) ? facts : empty_facts();
+            }
+            if (node.node_kind() != pattern_node::OPTIONAL && facts.max_length > 0) {
+                facts.max_length = pattern_facts::UNBOUNDED;
+            }
+            if (node.node_kind() != pattern_node::PLUS) {
+                facts.merge(empty_facts());
+            }
+            return facts;
+        }
+    }
+    return pattern_facts();
+}
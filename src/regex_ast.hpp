@@ -0,0 +1,88 @@
+#ifndef REGEX_AST_HPP
+#define REGEX_AST_HPP
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace regexs {
+    // Parsed form of a pattern, rewritten by simplify_pattern before the NFA is built.
+    // Nodes are immutable and shared between trees.
+    class pattern_node {
+    public:
+        enum kind {
+            EMPTY, LITERAL, CLASS, CONCAT, ALTERNATE, STAR, PLUS, OPTIONAL
+        };
+
+        using char_set = std::bitset<256>;
+        using pointer = std::shared_ptr<const pattern_node>;
+
+        static pointer empty();
+        static pointer literal(std::string text);
+        static pointer char_class(const char_set& chars);
+        static pointer concat(std::vector<pointer> children);
+        static pointer alternate(std::vector<pointer> children);
+        static pointer repeat(kind op, pointer child);
+
+        inline kind node_kind() const { return __kind; }
+        inline const std::string& text() const { return __text; }
+        inline const char_set& chars() const { return __chars; }
+        inline const std::vector<pointer>& children() const { return __children; }
+
+        size_t size() const;
+        std::string serialize() const;
+    private:
+        kind __kind;
+        std::string __text;
+        char_set __chars;
+        std::vector<pointer> __children;
+
+        explicit pattern_node(kind k) : __kind(k) {}
+    };
+
+    // Rewrites the pattern into an equivalent and usually smaller one: alternations are
+    // deduplicated and factored into prefix and suffix tries, single characters are merged
+    // into classes, and nested repetitions are collapsed.
+    pattern_node::pointer simplify_pattern(const pattern_node::pointer& node, bool case_insensitive = false);
+
+    // The pattern matching the reversal of every string the given one matches
+    pattern_node::pointer reverse_pattern(const pattern_node::pointer& node);
+
+    // Bounds on the strings a pattern matches, cheap enough to check before running any
+    // automaton. Default-constructed facts belong to a pattern that matches nothing, and
+    // merging facts gives the facts of the alternation.
+    struct pattern_facts {
+        static constexpr size_t UNBOUNDED = SIZE_MAX;
+
+        size_t min_length = UNBOUNDED;
+        size_t max_length = 0;                  // UNBOUNDED if the pattern repeats
+        pattern_node::char_set first_bytes;     // of the non-empty matches
+        pattern_node::char_set last_bytes;
+        bool nullable = false;
+
+        // False only if no match of the pattern can be exactly sv
+        inline bool admits(std::string_view sv) const {
+            if (sv.empty()) {
+                return nullable;
+            }
+            return sv.size() >= min_length && sv.size() <= max_length
+                && first_bytes.test(static_cast<unsigned char>(sv.front()))
+                && last_bytes.test(static_cast<unsigned char>(sv.back()));
+        }
+        void merge(const pattern_facts& other);
+        std::string serialize() const;
+    };
+
+    pattern_facts analyze_pattern(const pattern_node& node, bool case_insensitive = false);
+
+    // Lists every string the pattern matches, sorted and deduplicated, or nothing if the
+    // pattern repeats or matches more than limit strings.
+    std::optional<std::vector<std::string>> finite_language(const pattern_node::pointer& node, size_t limit);
+}
+
+#endif
@@ -0,0 +1,324 @@
+#include "regex_bitparallel.hpp"
+#include <stdexcept>
+
+using namespace regexs;
+using mask = bit_parallel_nfa::mask;
+
+static size_t count_positions(const pattern_node& node) {
+    switch (node.node_kind()) {
+    case pattern_node::LITERAL:
+        return node.text().size();
+    case pattern_node::CLASS:
+        return 1;
+    default:
+        {
+            size_t total = 0;
+            for (auto& child : node.children()) {
+                total += count_positions(*child);
+                if (total > bit_parallel_nfa::MAX_POSITIONS) break;
+            }
+            return total;
+        }
+    }
+}
+
+namespace {
+    // Positions are numbered left to right, so the characters of a literal get
+    // consecutive bits
+    struct glushkov_builder {
+        bool case_insensitive;
+        std::vector<pattern_node::char_set> chars;
+        std::vector<mask> follow;
+
+        struct fragment {
+            bool nullable;
+            mask first;
+            mask last;
+        };
+
+        mask add_position(const pattern_node::char_set& cs) {
+            chars.push_back(cs);
+            follow.push_back(0);
+            return mask(1) << (chars.size() - 1);
+        }
+
+        void link(mask from, mask to) {
+            for (size_t p = 0; p < follow.size(); p++) {
+                if ((from >> p) & 1) follow[p] |= to;
+            }
+        }
+
+        fragment build(const pattern_node& node) {
+            switch (node.node_kind()) {
+            case pattern_node::EMPTY:
+                return {true, 0, 0};
+            case pattern_node::LITERAL:
+                {
+                    mask first = 0, last = 0;
+                    for (char ch : node.text()) {
+                        pattern_node::char_set cs;
+                        unsigned char b = static_cast<unsigned char>(ch);
+                        cs.set(b);
+                        if (case_insensitive && ((b >= 'a' && b <= 'z') || (b >= 'A' && b <= 'Z'))) {
+                            cs.set(b ^ 0x20);
+                        }
+                        mask p = add_position(cs);
+                        if (first == 0) {
+                            first = p;
+                        } else {
+                            link(last, p);
+                        }
+                        last = p;
+                    }
+                    return {false, first, last};
+                }
+            case pattern_node::CLASS:
+                {
+                    mask p = add_position(node.chars());
+                    return {false, p, p};
+                }
+            case pattern_node::CONCAT:
+                {
+                    fragment f{true, 0, 0};
+                    for (auto& child : node.children()) {
+                        fragment g = build(*child);
+                        link(f.last, g.first);
+                        f = {
+                            f.nullable && g.nullable,
+                            f.nullable ? (f.first | g.first) : f.first,
+                            g.nullable ? (f.last | g.last) : g.last
+                        };
+                    }
+                    return f;
+                }
+            case pattern_node::ALTERNATE:
+                {
+                    fragment f{false, 0, 0};
+                    for (auto& child : node.children()) {
+                        fragment g = build(*child);
+                        f = {f.nullable || g.nullable, f.first | g.first, f.last | g.last};
+                    }
+                    return f;
+                }
+            case pattern_node::STAR:
+            case pattern_node::PLUS:
+            case pattern_node::OPTIONAL:
+                {
+                    fragment f = build(*node.children()[0]);
+                    if (node.node_kind() != pattern_node::OPTIONAL) {
+                        link(f.last, f.first);
+                    }
+                    if (node.node_kind() != pattern_node::PLUS) {
+                        f.nullable = true;
+                    }
+                    return f;
+                }
+            }
+            return {true, 0, 0};
+        }
+    };
+}
+
+bool bit_parallel_nfa::fits(const pattern_node& node) {
+    return count_positions(node) <= MAX_POSITIONS;
+}
+
+bit_parallel_nfa::bit_parallel_nfa(const pattern_node& node, bool case_insensitive) : __shift_only(0) {
+    if (!fits(node)) {
+        throw std::logic_error("pattern has too many positions for the bit-parallel engine");
+    }
+
+    glushkov_builder builder{case_insensitive, {}, {}};
+    glushkov_builder::fragment f = builder.build(node);
+    __positions = builder.chars.size();
+    __nullable = f.nullable;
+    __first = f.first;
+    __last = f.last;
+
+    __byte_masks.fill(0);
+    for (size_t p = 0; p < __positions; p++) {
+        for (size_t b = 0; b < 256; b++) {
+            if (builder.chars[p].test(b)) __byte_masks[b] |= mask(1) << p;
+        }
+        if (p + 1 < __positions && builder.follow[p] == mask(1) << (p + 1)) {
+            __shift_only |= mask(1) << p;
+        }
+    }
+
+    __follow_tables.resize((__positions + 7) / 8);
+    for (size_t chunk = 0; chunk < __follow_tables.size(); chunk++) {
+        for (size_t bits = 0; bits < 256; bits++) {
+            mask reach = 0;
+            for (size_t j = 0; j < 8 && chunk * 8 + j < __positions; j++) {
+                if ((bits >> j) & 1) reach |= builder.follow[chunk * 8 + j];
+            }
+            __follow_tables[chunk][bits] = reach;
+        }
+    }
+}
+
+bit_parallel_nfa::error_levels bit_parallel_nfa::start_levels(size_t edits) const {
+    if (edits > MAX_EDITS) {
+        throw std::invalid_argument("too many edits for the bit-parallel engine");
+    }
+
+    // Positions reachable by skipping up to j of them before reading anything
+    error_levels lv;
+    lv.edits = edits;
+    lv.reach[0] = 0;
+    lv.initial.fill(true);
+    for (size_t j = 1; j <= edits; j++) {
+        lv.reach[j] = lv.reach[j - 1] | follow(lv.reach[j - 1]) | __first;
+    }
+    return lv;
+}
+
+void bit_parallel_nfa::advance(error_levels& lv, char ch, bool inject) const {
+    mask b = __byte_masks[static_cast<unsigned char>(ch)];
+    std::array<mask, MAX_EDITS + 1> reached;
+    for (size_t j = 0; j <= lv.edits; j++) {
+        reached[j] = follow(lv.reach[j]) | (lv.initial[j] ? __first : 0);
+    }
+
+    mask prev_reach = lv.reach[0];
+    bool prev_initial = lv.initial[0];
+    lv.reach[0] = reached[0] & b;
+    lv.initial[0] = inject;
+    for (size_t j = 1; j <= lv.edits; j++) {
+        mask old_reach = lv.reach[j];
+        bool old_initial = lv.initial[j];
+        lv.reach[j] = (reached[j] & b)
+                    | reached[j - 1]
+                    | prev_reach
+                    | follow(lv.reach[j - 1]) | (lv.initial[j - 1] ? __first : 0);
+        lv.initial[j] = inject || prev_initial;
+        prev_reach = old_reach;
+        prev_initial = old_initial;
+    }
+}
+
+bool bit_parallel_nfa::match(std::string_view sv, size_t edits) const {
+    if (edits > 0) {
+        error_levels lv = start_levels(edits);
+        for (size_t i = 0; i < sv.size() && !dead(lv); i++) {
+            advance(lv, sv[i], false);
+        }
+        return accepts(lv);
+    }
+
+    if (sv.empty()) {
+        return __nullable;
+    }
+    mask d = step(0, __first, sv[0]);
+    for (size_t i = 1; i < sv.size() && d != 0; i++) {
+        d = step(d, 0, sv[i]);
+    }
+    return (d & __last) != 0;
+}
+
+std::optional<size_t> bit_parallel_nfa::earliest_end(std::string_view sv, bool anchored, size_t edits) const {
+    if (edits > 0) {
+        error_levels lv = start_levels(edits);
+        if (accepts(lv)) {
+            return 0;
+        }
+        for (size_t i = 0; i < sv.size(); i++) {
+            advance(lv, sv[i], !anchored);
+            if (accepts(lv)) {
+                return i + 1;
+            }
+            if (anchored && dead(lv)) {
+                break;
+            }
+        }
+        return std::nullopt;
+    }
+
+    if (__nullable) {
+        return 0;
+    }
+    mask d = 0;
+    for (size_t i = 0; i < sv.size(); i++) {
+        d = step(d, (anchored && i != 0) ? 0 : __first, sv[i]);
+        if ((d & __last) != 0) {
+            return i + 1;
+        }
+        if (anchored && d == 0) {
+            break;
+        }
+    }
+    return std::nullopt;
+}
+
+bool bit_parallel_nfa::matches_suffix(std::string_view sv, size_t edits) const {
+    if (edits > 0) {
+        error_levels lv = start_levels(edits);
+        for (char ch : sv) {
+            advance(lv, ch, true);
+        }
+        return accepts(lv);
+    }
+
+    if (__nullable) {
+        return true;
+    }
+    mask d = 0;
+    for (char ch : sv) {
+        d = step(d, __first, ch);
+    }
+    return (d & __last) != 0;
+}
+
+size_t bit_parallel_nfa::leftmost_start(std::string_view sv, size_t end, size_t edits) const {
+    size_t begin = end;
+    if (edits > 0) {
+        error_levels lv = start_levels(edits);
+        for (size_t i = end; i > 0 && !dead(lv); i--) {
+            advance(lv, sv[i - 1], false);
+            if (accepts(lv)) {
+                begin = i - 1;
+            }
+        }
+        return begin;
+    }
+
+    mask d = 0;
+    for (size_t i = end; i > 0; i--) {
+        d = step(d, (i == end) ? __first : 0, sv[i - 1]);
+        if (d == 0) {
+            break;
+        }
+        if ((d & __last) != 0) {
+            begin = i - 1;
+        }
+    }
+    return begin;
+}
+
+void bit_parallel_nfa::scan_lines(
+    std::string_view buffer,
+    const transition_table::line_callback& on_line,
+    bool anchor_begin,
+    bool anchor_end,
+    size_t edits
+) const {
+    size_t line_begin = 0;
+    while (line_begin < buffer.size()) {
+        size_t line_end = buffer.find(transition_table::LINE_DELIMITER, line_begin);
+        if (line_end == std::string_view::npos) {
+            line_end = buffer.size();
+        }
+
+        std::string_view line = buffer.substr(line_begin, line_end - line_begin);
+        bool found;
+        if (anchor_end) {
+            found = anchor_begin ? match(line, edits) : matches_suffix(line, edits);
+        } else {
+            found = earliest_end(line, anchor_begin, edits).has_value();
+        }
+        if (found) {
+            on_line(line_begin, line_end);
+        }
+        line_begin = line_end + 1;
+    }
+}
@@ -0,0 +1,101 @@
+#ifndef REGEX_BITPARALLEL_HPP
+#define REGEX_BITPARALLEL_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "regex_ast.hpp"
+#include "regex_table.hpp"
+
+namespace regexs {
+    // Position (Glushkov) automaton of a pattern with at most 64 character positions,
+    // simulated with the whole state set in one word. A step is
+    //     D = (follow(D) | injected) & B[byte]
+    // where B holds the positions each byte may occupy and follow(D) is the union of the
+    // follow sets of D. Positions followed only by the next one, as inside a literal, are
+    // advanced with a shift like in shift-and; the others are looked up one non-zero
+    // byte of D at a time.
+    //
+    // Building it is linear in the pattern, so it serves patterns that are used too
+    // briefly to pay for a subset construction.
+    //
+    // With edits > 0 the methods accept inputs within that many insertions, deletions and
+    // substitutions of a match (Wu-Manber). Level j holds the positions reachable with at
+    // most j edits, plus whether the state before the first position still is:
+    //     R'[j] = step(R[j]) | follow(R[j-1]) | R[j-1] | follow(R'[j-1])
+    // for a substitution, an inserted byte and a skipped position, each costing one edit.
+    class bit_parallel_nfa {
+    public:
+        using mask = uint64_t;
+
+        static constexpr size_t MAX_POSITIONS = 64;
+        static constexpr size_t MAX_EDITS = 8;
+
+        static bool fits(const pattern_node& node);
+
+        bit_parallel_nfa(const pattern_node& node, bool case_insensitive = false);
+
+        inline size_t position_count() const { return __positions; }
+
+        // The whole input matches
+        bool match(std::string_view sv, size_t edits = 0) const;
+        // End of the match that ends first, starting anywhere unless anchored
+        std::optional<size_t> earliest_end(std::string_view sv, bool anchored, size_t edits = 0) const;
+        // Some match, starting anywhere, ends where the input does
+        bool matches_suffix(std::string_view sv, size_t edits = 0) const;
+        // For an automaton of the reversed pattern: the leftmost start of a match that
+        // ends at end
+        size_t leftmost_start(std::string_view sv, size_t end, size_t edits = 0) const;
+        void scan_lines(
+            std::string_view buffer,
+            const transition_table::line_callback& on_line,
+            bool anchor_begin,
+            bool anchor_end,
+            size_t edits = 0
+        ) const;
+    private:
+        struct error_levels {
+            size_t edits;
+            std::array<mask, MAX_EDITS + 1> reach;
+            std::array<bool, MAX_EDITS + 1> initial;    // nothing read from the pattern yet
+        };
+
+        size_t __positions;
+        bool __nullable;
+        mask __first;
+        mask __last;
+        std::array<mask, 256> __byte_masks;
+        mask __shift_only;
+        std::vector<std::array<mask, 256>> __follow_tables;    // one per byte of D
+
+        inline mask follow(mask d) const {
+            mask reach = (d & __shift_only) << 1;
+            mask rest = d & ~__shift_only;
+            while (rest != 0) {
+                size_t chunk = __builtin_ctzll(rest) / 8;
+                reach |= __follow_tables[chunk][(rest >> (8 * chunk)) & 0xff];
+                rest &= ~(mask(0xff) << (8 * chunk));
+            }
+            return reach;
+        }
+        inline mask step(mask d, mask injected, char ch) const {
+            return (follow(d) | injected) & __byte_masks[static_cast<unsigned char>(ch)];
+        }
+
+        error_levels start_levels(size_t edits) const;
+        // inject keeps the initial state active without an edit, for unanchored starts
+        void advance(error_levels& lv, char ch, bool inject) const;
+        inline bool accepts(const error_levels& lv) const {
+            return (lv.reach[lv.edits] & __last) != 0 || (__nullable && lv.initial[lv.edits]);
+        }
+        inline bool dead(const error_levels& lv) const {
+            return lv.reach[lv.edits] == 0 && !lv.initial[lv.edits];
+        }
+    };
+}
+
+#endif
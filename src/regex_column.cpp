@@ -0,0 +1,248 @@
+#include "regex_column.hpp"
+#include <cstring>
+#include <limits>
+#include <sstream>
+
+using namespace regexs;
+
+double column_matcher::cache_stats::hit_rate() const {
+    size_t lookups = hits + misses;
+    return (lookups == 0) ? 0.0 : static_cast<double>(hits) / lookups;
+}
+
+std::string column_matcher::cache_stats::serialize() const {
+    std::stringstream seri_stream;
+    seri_stream << "VALUES = " << values << '\n'
+                << "HITS = " << hits << '\n'
+                << "MISSES = " << misses << '\n'
+                << "UNCACHED = " << uncached << '\n'
+                << "EVICTIONS = " << evictions << '\n'
+                << "HIT_RATE = " << hit_rate() << '\n';
+    return seri_stream.str();
+}
+
+column_matcher::column_matcher(const regex& re, size_t capacity) :
+    __regex(&re),
+    __set(nullptr),
+    __capacity(capacity),
+    __slots(capacity > 0 ? 16 : 0),
+    __size(0)
+{
+    intern({});
+}
+
+column_matcher::column_matcher(const regex_set& set, size_t capacity) :
+    __regex(nullptr),
+    __set(&set),
+    __capacity(capacity),
+    __slots(capacity > 0 ? 16 : 0),
+    __size(0)
+{
+    intern({});
+}
+
+column_matcher::column_result column_matcher::match(const std::vector<std::string_view>& column) {
+    __stats.values += column.size();
+    return expand(resolve(column));
+}
+
+column_matcher::column_result column_matcher::match(const std::vector<std::string_view>& dictionary, const std::vector<uint32_t>& codes) {
+    // Only the dictionary entries the column uses are resolved
+    constexpr uint32_t UNUSED = std::numeric_limits<uint32_t>::max();
+    std::vector<uint32_t> position(dictionary.size(), UNUSED);
+    std::vector<std::string_view> used;
+    for (uint32_t code : codes) {
+        if (position[code] == UNUSED) {
+            position[code] = static_cast<uint32_t>(used.size());
+            used.push_back(dictionary[code]);
+        }
+    }
+
+    std::vector<uint32_t> verdicts = resolve(used);
+    std::vector<uint32_t> rows(codes.size());
+    for (size_t i = 0; i < codes.size(); i++) {
+        rows[i] = verdicts[position[codes[i]]];
+    }
+    __stats.values += codes.size();
+    return expand(rows);
+}
+
+void column_matcher::reset_stats() {
+    __stats = cache_stats();
+}
+
+void column_matcher::clear() {
+    __slots.assign(__slots.size(), slot{});
+    __size = 0;
+    __bytes.clear();
+    __mark_ids.clear();
+    __mark_sets.clear();
+    intern({});
+}
+
+static inline uint64_t load_word(const char* p) {
+    uint64_t word;
+    std::memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+// Cached values have at least eight bytes, so they are read in whole words, the last
+// ones overlapping the words before them. Lengths up to 32 bytes then take a fixed
+// number of steps with no loop to mispredict.
+static_assert(column_matcher::MIN_CACHED_BYTES >= 8, "values are read eight bytes at a time");
+
+static inline bool same_bytes(const char* a, const char* b, size_t n) {
+    uint64_t diff = (load_word(a) ^ load_word(b)) | (load_word(a + n - 8) ^ load_word(b + n - 8));
+    if (n > 16) {
+        diff |= (load_word(a + 8) ^ load_word(b + 8)) | (load_word(a + n - 16) ^ load_word(b + n - 16));
+        for (size_t i = 16; i + 16 < n; i += 16) {
+            diff |= (load_word(a + i) ^ load_word(b + i)) | (load_word(a + i + 8) ^ load_word(b + i + 8));
+        }
+    }
+    return diff == 0;
+}
+
+// Multiplies to 128 bits and folds the halves together
+static inline uint64_t fold_multiply(uint64_t a, uint64_t b) {
+    unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+    return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+}
+
+// Sixteen bytes per multiply, folded to 32 bits; 0 is kept for empty slots
+uint32_t column_matcher::hash_value(std::string_view value) {
+    constexpr uint64_t k0 = 0xa0761d6478bd642fULL, k1 = 0xe7037ed1a0b428dbULL;
+    const char* p = value.data();
+    size_t n = value.size();
+    uint64_t h = n;
+    if (n > 16) {
+        for (size_t i = 0; i + 16 < n; i += 16) {
+            h = fold_multiply(load_word(p + i) ^ k0 ^ h, load_word(p + i + 8) ^ k1);
+        }
+        h = fold_multiply(load_word(p + n - 16) ^ k0 ^ h, load_word(p + n - 8) ^ k1);
+    } else {
+        h = fold_multiply(load_word(p) ^ k0 ^ h, load_word(p + n - 8) ^ k1);
+    }
+    uint32_t folded = static_cast<uint32_t>(h ^ (h >> 32));
+    return (folded != 0) ? folded : 1;
+}
+
+// The slot holding value, or the empty slot where it would go
+column_matcher::slot& column_matcher::probe(std::string_view value, uint32_t hash) {
+    size_t mask = __slots.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        slot& s = __slots[i];
+        if (s.hash == 0 || (s.hash == hash && s.length == value.size()
+                && same_bytes(__bytes.data() + s.offset, value.data(), value.size()))) {
+            return s;
+        }
+    }
+}
+
+void column_matcher::grow() {
+    std::vector<slot> old = std::move(__slots);
+    __slots.assign(old.size() * 2, slot{});
+    size_t mask = __slots.size() - 1;
+    for (const slot& s : old) {
+        if (s.hash == 0) {
+            continue;
+        }
+        size_t i = s.hash & mask;
+        while (__slots[i].hash != 0) {
+            i = (i + 1) & mask;
+        }
+        __slots[i] = s;
+    }
+}
+
+uint32_t column_matcher::intern(std::set<int> marks) {
+    auto [it, inserted] = __mark_ids.emplace(std::move(marks), static_cast<uint32_t>(__mark_sets.size()));
+    if (inserted) {
+        __mark_sets.push_back(&it->first);
+    }
+    return it->second;
+}
+
+std::vector<uint32_t> column_matcher::resolve(const std::vector<std::string_view>& values) {
+    if (__size >= __capacity && __size > 0) {
+        __stats.evictions += __size;
+        __slots.assign(__slots.size(), slot{});
+        __size = 0;
+        __bytes.clear();
+    }
+
+    // Values to match, with the hash of those that get a slot and 0 for the rest
+    std::vector<uint32_t> verdicts(values.size());
+    std::vector<std::string_view> batch;
+    std::vector<uint32_t> batch_hashes;
+    size_t misses = 0;
+    for (size_t i = 0; i < values.size(); i++) {
+        std::string_view value = values[i];
+        uint32_t hash = 0;
+        if (__capacity > 0 && value.size() >= MIN_CACHED_BYTES && value.size() <= MAX_CACHED_BYTES) {
+            hash = hash_value(value);
+            slot& s = probe(value, hash);
+            if (s.hash != 0) {
+                verdicts[i] = s.verdict;
+                continue;
+            }
+            if (__size < __capacity && __bytes.size() + value.size() <= std::numeric_limits<uint32_t>::max()) {
+                s = slot{hash, static_cast<uint32_t>(value.size()), static_cast<uint32_t>(__bytes.size()), PENDING | static_cast<uint32_t>(batch.size())};
+                __bytes.append(value);
+                misses++;
+                if (++__size * 4 > __slots.size()) {
+                    grow();
+                }
+            } else {
+                hash = 0;
+            }
+        }
+        verdicts[i] = PENDING | static_cast<uint32_t>(batch.size());
+        batch.push_back(value);
+        batch_hashes.push_back(hash);
+    }
+    __stats.hits += values.size() - batch.size();
+    __stats.misses += misses;
+    __stats.uncached += batch.size() - misses;
+
+    if (batch.empty()) {
+        return verdicts;
+    }
+    std::vector<uint32_t> batch_verdicts(batch.size());
+    if (__regex != nullptr) {
+        std::vector<bool> matched = __regex->match_batch(batch);
+        for (size_t k = 0; k < batch.size(); k++) {
+            batch_verdicts[k] = matched[k] ? MATCHED : 0;
+        }
+    } else {
+        std::vector<std::set<int>> marks = __set->match_batch(batch);
+        for (size_t k = 0; k < batch.size(); k++) {
+            batch_verdicts[k] = marks[k].empty() ? 0 : (MATCHED | intern(std::move(marks[k])));
+        }
+    }
+    for (size_t k = 0; k < batch.size(); k++) {
+        if (batch_hashes[k] != 0) {
+            probe(batch[k], batch_hashes[k]).verdict = batch_verdicts[k];
+        }
+    }
+    for (uint32_t& verdict : verdicts) {
+        if ((verdict & PENDING) != 0) {
+            verdict = batch_verdicts[verdict & ~PENDING];
+        }
+    }
+    return verdicts;
+}
+
+column_matcher::column_result column_matcher::expand(const std::vector<uint32_t>& verdicts) const {
+    column_result result;
+    result.matched.resize(verdicts.size());
+    for (size_t i = 0; i < verdicts.size(); i++) {
+        result.matched[i] = (verdicts[i] & MATCHED) != 0;
+    }
+    if (__set != nullptr) {
+        result.marks.resize(verdicts.size());
+        for (size_t i = 0; i < verdicts.size(); i++) {
+            result.marks[i] = __mark_sets[verdicts[i] & MARKS];
+        }
+    }
+    return result;
+}
@@ -0,0 +1,99 @@
+#ifndef REGEX_COLUMN_HPP
+#define REGEX_COLUMN_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "regex.hpp"
+#include "regex_set.hpp"
+
+namespace regexs {
+    // Matches columns of values that repeat a lot, such as status codes or host names.
+    // Every value is hashed once and probed in a flat open-addressed table whose slots
+    // hold the verdict and an index into the interned mark sets, so a hit costs one hash
+    // and one probe. Misses, repeats of a miss included, are matched in one match_batch
+    // call. Values shorter than MIN_CACHED_BYTES skip the table and go straight into
+    // that batch, since a DFA walks them faster than they hash and probe.
+    //
+    // The table holds at most capacity values. Once it is full, later values are
+    // matched without it, and the next call starts it over.
+    //
+    // The matcher keeps a reference to the regex or set, which must outlive it; call
+    // clear() after adding or removing patterns.
+    class column_matcher {
+    public:
+        static constexpr size_t DEFAULT_CAPACITY = 1 << 16;
+        // Shorter values are matched directly, longer ones are matched but not cached
+        static constexpr size_t MIN_CACHED_BYTES = 8;
+        static constexpr size_t MAX_CACHED_BYTES = 1024;
+
+        struct cache_stats {
+            size_t values = 0;      // column entries
+            size_t hits = 0;
+            size_t misses = 0;
+            size_t uncached = 0;    // values matched without the table
+            size_t evictions = 0;
+
+            double hit_rate() const;
+            std::string serialize() const;
+        };
+
+        // matched has one entry per value. For a set, marks does as well; the sets live
+        // in the matcher and stay valid until clear(). A regex gives no marks.
+        struct column_result {
+            std::vector<bool> matched;
+            std::vector<const std::set<int>*> marks;
+        };
+
+        explicit column_matcher(const regex& re, size_t capacity = DEFAULT_CAPACITY);
+        explicit column_matcher(const regex_set& set, size_t capacity = DEFAULT_CAPACITY);
+
+        column_result match(const std::vector<std::string_view>& column);
+        // Dictionary-encoded column: value i is dictionary[codes[i]]
+        column_result match(const std::vector<std::string_view>& dictionary, const std::vector<uint32_t>& codes);
+
+        inline size_t capacity() const { return __capacity; }
+        inline size_t size() const { return __size; }
+        inline const cache_stats& stats() const { return __stats; }
+        void reset_stats();
+        void clear();
+    private:
+        // A verdict is an index into __mark_sets, with MATCHED set for a match; PENDING
+        // instead marks a value of the current batch, with its position in the low bits
+        static constexpr uint32_t MATCHED = 1u << 30;
+        static constexpr uint32_t PENDING = 1u << 31;
+        static constexpr uint32_t MARKS = MATCHED - 1;
+
+        struct slot {
+            uint32_t hash;      // 0 for an empty slot
+            uint32_t length;
+            uint32_t offset;    // of the value in __bytes
+            uint32_t verdict;
+        };
+
+        const regex* __regex;
+        const regex_set* __set;
+        size_t __capacity;
+        std::vector<slot> __slots;      // power of two, at most a quarter full
+        size_t __size;
+        std::string __bytes;
+        std::map<std::set<int>, uint32_t> __mark_ids;
+        std::vector<const std::set<int>*> __mark_sets;     // [0] is the empty set
+        cache_stats __stats;
+
+        static uint32_t hash_value(std::string_view value);
+        slot& probe(std::string_view value, uint32_t hash);
+        void grow();
+        uint32_t intern(std::set<int> marks);
+        // The verdict of every value, matching the misses in one batch
+        std::vector<uint32_t> resolve(const std::vector<std::string_view>& values);
+        column_result expand(const std::vector<uint32_t>& verdicts) const;
+    };
+}
+
+#endif
@@ -0,0 +1,249 @@
+#include "regex_compact.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <sstream>
+
+using namespace regexs;
+using state = compact_table::state;
+
+class compact_table::rows {
+public:
+    virtual ~rows() = default;
+    virtual state next_state(state s, unsigned char cls) const = 0;
+    virtual state run(state s, const deterministic_automaton::byte_class_map& classes, state dead, std::string_view sv) const = 0;
+    virtual size_t memory_usage() const = 0;
+};
+
+// The byte loop is written once per encoding so that step() inlines into it
+template <typename Rows>
+static state run_rows(const Rows& rows, state s, const deterministic_automaton::byte_class_map& classes, state dead, std::string_view sv) {
+    for (char c : sv) {
+        s = rows.step(s, classes[static_cast<unsigned char>(c)]);
+        if (s == dead) break;
+    }
+    return s;
+}
+
+template <typename Id>
+class compact_table::dense_rows : public compact_table::rows {
+public:
+    explicit dense_rows(const transition_table& table) :
+        __class_count(table.class_count()),
+        __next(table.state_count() * table.class_count())
+    {
+        for (state s = 0; s < table.state_count(); s++) {
+            for (size_t k = 0; k < __class_count; k++) {
+                __next[s * __class_count + k] = static_cast<Id>(table.class_next_state(s, k));
+            }
+        }
+    }
+
+    inline state step(state s, unsigned char cls) const {
+        return __next[s * __class_count + cls];
+    }
+
+    state next_state(state s, unsigned char cls) const override { return step(s, cls); }
+    state run(state s, const deterministic_automaton::byte_class_map& classes, state dead, std::string_view sv) const override {
+        return run_rows(*this, s, classes, dead, sv);
+    }
+    size_t memory_usage() const override { return __next.size() * sizeof(Id); }
+private:
+    size_t __class_count;
+    std::vector<Id> __next;
+};
+
+// Row displacement: entry (s, k) lives at base[s] + k when check there names s,
+// otherwise it is the row default. Rows are placed first-fit, fullest first.
+template <typename Id>
+class compact_table::comb_rows : public compact_table::rows {
+public:
+    static constexpr Id EMPTY = std::numeric_limits<Id>::max();
+
+    explicit comb_rows(const transition_table& table) :
+        __base(table.state_count()),
+        __defaults(table.state_count())
+    {
+        size_t n = table.state_count();
+        size_t class_count = table.class_count();
+
+        std::vector<std::vector<unsigned char>> exceptions(n);
+        std::vector<state> row(class_count);
+        for (state s = 0; s < n; s++) {
+            for (size_t k = 0; k < class_count; k++) {
+                row[k] = table.class_next_state(s, k);
+            }
+            __defaults[s] = static_cast<Id>(most_common(row));
+            for (size_t k = 0; k < class_count; k++) {
+                if (row[k] != __defaults[s]) {
+                    exceptions[s].push_back(static_cast<unsigned char>(k));
+                }
+            }
+        }
+
+        std::vector<state> order(n);
+        for (state s = 0; s < n; s++) order[s] = s;
+        std::stable_sort(order.begin(), order.end(), [&](state a, state b) {
+            return exceptions[a].size() > exceptions[b].size();
+        });
+
+        __check.assign(class_count, EMPTY);
+        __next.assign(class_count, EMPTY);
+        size_t first_free = 0;
+        for (state s : order) {
+            const auto& exc = exceptions[s];
+            if (exc.empty()) {
+                break;
+            }
+
+            size_t b = (first_free > exc.front()) ? first_free - exc.front() : 0;
+            for (;; b++) {
+                if (b + class_count > __check.size()) {
+                    __check.resize(b + class_count, EMPTY);
+                    __next.resize(b + class_count, EMPTY);
+                }
+                bool fits = std::all_of(exc.begin(), exc.end(), [&](unsigned char k) { return __check[b + k] == EMPTY; });
+                if (fits) break;
+            }
+
+            __base[s] = static_cast<uint32_t>(b);
+            for (unsigned char k : exc) {
+                __check[b + k] = static_cast<Id>(s);
+                __next[b + k] = static_cast<Id>(table.class_next_state(s, k));
+            }
+            while (first_free < __check.size() && __check[first_free] != EMPTY) {
+                first_free++;
+            }
+        }
+    }
+
+    static size_t exception_count(const transition_table& table) {
+        size_t total = 0;
+        std::vector<state> row(table.class_count());
+        for (state s = 0; s < table.state_count(); s++) {
+            for (size_t k = 0; k < row.size(); k++) {
+                row[k] = table.class_next_state(s, k);
+            }
+            state common = most_common(row);
+            total += std::count_if(row.begin(), row.end(), [&](state t) { return t != common; });
+        }
+        return total;
+    }
+
+    inline state step(state s, unsigned char cls) const {
+        size_t i = __base[s] + cls;
+        return (__check[i] == s) ? __next[i] : __defaults[s];
+    }
+
+    state next_state(state s, unsigned char cls) const override { return step(s, cls); }
+    state run(state s, const deterministic_automaton::byte_class_map& classes, state dead, std::string_view sv) const override {
+        return run_rows(*this, s, classes, dead, sv);
+    }
+    size_t memory_usage() const override {
+        return __base.size() * sizeof(uint32_t) + (__defaults.size() + __check.size() + __next.size()) * sizeof(Id);
+    }
+private:
+    std::vector<uint32_t> __base;
+    std::vector<Id> __defaults;
+    std::vector<Id> __check;
+    std::vector<Id> __next;
+
+    static state most_common(std::vector<state> row) {
+        std::sort(row.begin(), row.end());
+        state best = row.front();
+        size_t best_run = 0;
+        for (size_t i = 0, j; i < row.size(); i = j) {
+            for (j = i; j < row.size() && row[j] == row[i]; j++);
+            if (j - i > best_run) {
+                best = row[i];
+                best_run = j - i;
+            }
+        }
+        return best;
+    }
+};
+
+// The comb layout is slower per byte, so it has to save at least a quarter of the
+// dense size to be chosen. Its size is estimated from the exception count first,
+// since packing the rows is the expensive part.
+template <typename Id>
+std::unique_ptr<compact_table::rows> compact_table::build(const transition_table& table) {
+    size_t dense_bytes = table.state_count() * table.class_count() * sizeof(Id);
+    size_t row_bytes = table.state_count() * (sizeof(uint32_t) + sizeof(Id));
+    size_t estimate = row_bytes + comb_rows<Id>::exception_count(table) * 2 * sizeof(Id);
+
+    if (estimate * 4 < dense_bytes * 3) {
+        auto comb = std::make_unique<comb_rows<Id>>(table);
+        if (comb->memory_usage() * 4 < dense_bytes * 3) {
+            __encoding = COMB;
+            return comb;
+        }
+    }
+    __encoding = DENSE;
+    return std::make_unique<dense_rows<Id>>(table);
+}
+
+compact_table::compact_table(const transition_table& table) :
+    __classes(table.byte_classes()),
+    __stops(table.state_count()),
+    __start_state(table.start_state()),
+    __dead_state(table.dead_state())
+{
+    size_t n = table.state_count();
+    for (state s = 0; s < n; s++) {
+        __stops[s] = table.is_stop_state(s);
+        if (__stops[s] && !table.state_mark(s).empty()) {
+            __marks[s] = table.state_mark(s);
+        }
+    }
+
+    // One ID value is kept free as the comb's empty marker
+    if (n < std::numeric_limits<uint8_t>::max()) {
+        __id_width = 1;
+    } else if (n < std::numeric_limits<uint16_t>::max()) {
+        __id_width = 2;
+    } else {
+        __id_width = 4;
+    }
+    __rows = (__id_width == 1) ? build<uint8_t>(table)
+           : (__id_width == 2) ? build<uint16_t>(table)
+           : build<uint32_t>(table);
+}
+
+compact_table::~compact_table() = default;
+
+bool compact_table::worth_compacting(const transition_table& table) {
+    return table.state_count() * table.class_count() * sizeof(state) > CACHE_BUDGET;
+}
+
+size_t compact_table::memory_usage() const {
+    size_t mark_bytes = 0;
+    for (auto& [s, marks] : __marks) {
+        mark_bytes += sizeof(s) + marks.size() * sizeof(int);
+    }
+    return __rows->memory_usage() + sizeof(__classes) + __stops.size() / 8 + mark_bytes;
+}
+
+state compact_table::next_state(state s, char ch) const {
+    return __rows->next_state(s, __classes[static_cast<unsigned char>(ch)]);
+}
+
+const std::set<int>& compact_table::state_mark(state s) const {
+    static const std::set<int> no_marks;
+    auto it = __marks.find(s);
+    return (it != __marks.end()) ? it->second : no_marks;
+}
+
+// Advances over the whole input, leaving early once the state is dead
+state compact_table::run(state s, std::string_view sv) const {
+    return __rows->run(s, __classes, __dead_state, sv);
+}
+
+std::string compact_table::serialize() const {
+    std::stringstream seri_stream;
+    seri_stream << "ENCODING = " << (__encoding == COMB ? "COMB" : "DENSE") << '\n';
+    seri_stream << "ID_WIDTH = " << __id_width << '\n';
+    seri_stream << "STATES = " << state_count() << '\n';
+    seri_stream << "BYTES = " << memory_usage() << '\n';
+    return seri_stream.str();
+}
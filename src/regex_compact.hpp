@@ -0,0 +1,71 @@
+#ifndef REGEX_COMPACT_HPP
+#define REGEX_COMPACT_HPP
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "regex_table.hpp"
+
+namespace regexs {
+    // Smaller encoding of a transition_table for automata too large to stay in cache.
+    // State IDs take 8, 16 or 32 bits depending on the state count, and rows are either
+    // stored densely or comb-packed: each row keeps its most common target as a default,
+    // and only the other entries go into a shared array at a per-row displacement. The
+    // smaller encoding is picked when it is built.
+    //
+    // It keeps the state numbering of the source table but none of its loop shortcuts,
+    // so it only pays off once the dense table stops fitting in cache.
+    class compact_table {
+    public:
+        using state = transition_table::state;
+
+        enum encoding {
+            DENSE, COMB
+        };
+
+        static constexpr size_t CACHE_BUDGET = 256 * 1024;
+
+        explicit compact_table(const transition_table& table);
+        ~compact_table();
+
+        static bool worth_compacting(const transition_table& table);
+
+        inline size_t state_count() const { return __stops.size(); }
+        inline encoding table_encoding() const { return __encoding; }
+        inline size_t id_width() const { return __id_width; }
+        size_t memory_usage() const;
+
+        inline state start_state() const { return __start_state; }
+        inline state dead_state() const { return __dead_state; }
+        state next_state(state s, char ch) const;
+        inline bool is_stop_state(state s) const { return __stops[s]; }
+        const std::set<int>& state_mark(state s) const;
+
+        state run(state s, std::string_view sv) const;
+
+        std::string serialize() const;
+    private:
+        class rows;
+        template <typename Id> class dense_rows;
+        template <typename Id> class comb_rows;
+
+        deterministic_automaton::byte_class_map __classes;
+        std::unique_ptr<rows> __rows;
+        encoding __encoding;
+        size_t __id_width;
+        std::vector<bool> __stops;
+        std::map<state, std::set<int>> __marks;
+        state __start_state;
+        state __dead_state;
+
+        template <typename Id>
+        std::unique_ptr<rows> build(const transition_table& table);
+    };
+}
+
+#endif
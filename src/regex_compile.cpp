@@ -0,0 +1,66 @@
+#include "regex_compile.hpp"
+#include <sstream>
+
+using namespace regexs;
+using clock_type = std::chrono::steady_clock;
+
+void compile_stats::record_nfa(const nondeterministic_automaton& nfa) {
+    nfa_states = nfa.state_count();
+    nfa_edges = nfa.edge_count();
+    nfa_epsilon_edges = nfa.epsilon_edge_count();
+}
+
+void compile_stats::record_dfa(const deterministic_automaton& dfa) {
+    deterministic_automaton::byte_class_map classes;
+    dfa_states = dfa.state_count();
+    transition_bytes = dfa.memory_usage();
+    byte_classes = dfa.byte_classes(classes);
+}
+
+std::string compile_stats::serialize() const {
+    auto us = [](duration d) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+    };
+
+    std::stringstream seri_stream;
+    seri_stream << "NFA_STATES = " << nfa_states << '\n'
+                << "NFA_EDGES = " << nfa_edges << '\n'
+                << "NFA_EPSILON_EDGES = " << nfa_epsilon_edges << '\n'
+                << "DFA_STATES_RAW = " << dfa_states_raw << '\n'
+                << "DFA_STATES = " << dfa_states << '\n'
+                << "TRANSITION_BYTES = " << transition_bytes << '\n'
+                << "BYTE_CLASSES = " << byte_classes << '\n'
+                << "DERIVATIVE_EXPRESSIONS = " << derivative_expressions << '\n'
+                << "TOKENIZE_US = " << us(tokenize_time) << '\n'
+                << "BUILD_NFA_US = " << us(build_nfa_time) << '\n'
+                << "SUBSET_CONSTRUCTION_US = " << us(subset_construction_time) << '\n'
+                << "SIMPLIFY_US = " << us(simplify_time) << '\n'
+                << "DERIVATIVE_US = " << us(derivative_time) << '\n';
+    return seri_stream.str();
+}
+
+deterministic_automaton regexs::compile_dfa(
+    const nondeterministic_automaton& nfa,
+    const compile_options& options,
+    compile_stats* stats
+) {
+    if (stats != nullptr) {
+        stats->record_nfa(nfa);
+    }
+
+    auto t0 = clock_type::now();
+    deterministic_automaton dfa = nfa.parallel_subset_construction(options.threads, options.max_dfa_states, options.max_dfa_bytes);
+    auto t1 = clock_type::now();
+    size_t raw_states = dfa.state_count();
+    dfa.parallel_simplify(options.threads);
+    auto t2 = clock_type::now();
+
+    if (stats != nullptr) {
+        stats->dfa_states_raw = raw_states;
+        stats->record_dfa(dfa);
+        stats->subset_construction_time = t1 - t0;
+        stats->simplify_time = t2 - t1;
+    }
+
+    return dfa;
+}
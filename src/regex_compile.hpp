@@ -0,0 +1,79 @@
+#ifndef REGEX_COMPILE_HPP
+#define REGEX_COMPILE_HPP
+
+#include <chrono>
+#include <limits>
+#include <string>
+
+#include "regex_dfa.hpp"
+#include "regex_nfa.hpp"
+
+namespace regexs {
+    struct compile_options {
+        enum budget_policy {
+            FAIL, FALLBACK_NFA
+        };
+
+        size_t max_dfa_states = std::numeric_limits<size_t>::max();
+        size_t max_dfa_bytes = std::numeric_limits<size_t>::max();
+        budget_policy on_budget_exceeded = FALLBACK_NFA;
+        bool case_insensitive = false;
+        // Worker threads for subset construction and minimization; 1 keeps both sequential
+        size_t threads = 1;
+        // Patterns that match at most this many fixed strings are searched for directly
+        // instead of through a DFA; 0 turns the literal engines off
+        size_t max_literals = 4096;
+        // Input bytes that patterns with few enough positions match with the bit-parallel
+        // engine before the DFA is built; 0 builds the DFA on first use
+        size_t bit_parallel_bytes = 1 << 20;
+        // regex_set keeps patterns whose merged DFA would pass this many states in
+        // separate shards; max_dfa_states bounds it as well
+        size_t max_shard_states = 1 << 13;
+        // Build the match DFA from pattern derivatives instead of the NFA
+        bool derivatives = false;
+        // match, search and scan_lines also accept inputs within this many insertions,
+        // deletions and substitutions of a match. Runs on the bit-parallel engine, so
+        // the pattern may have at most 64 positions and the automata stay exact.
+        size_t max_edits = 0;
+        // Run everything on the plain transition tables, the only loops a REGEX_PROFILE
+        // build counts: no literal, bit-parallel, shuffle or compact engine
+        bool profile = false;
+
+        bool has_budget() const {
+            return max_dfa_states != std::numeric_limits<size_t>::max()
+                || max_dfa_bytes != std::numeric_limits<size_t>::max();
+        }
+    };
+
+    struct compile_stats {
+        using duration = std::chrono::nanoseconds;
+
+        size_t nfa_states = 0;
+        size_t nfa_edges = 0;
+        size_t nfa_epsilon_edges = 0;
+        size_t dfa_states_raw = 0;
+        size_t dfa_states = 0;
+        size_t transition_bytes = 0;
+        size_t byte_classes = 0;
+        size_t derivative_expressions = 0;
+
+        duration tokenize_time{};
+        duration build_nfa_time{};
+        duration subset_construction_time{};
+        duration simplify_time{};
+        duration derivative_time{};
+
+        void record_nfa(const nondeterministic_automaton& nfa);
+        void record_dfa(const deterministic_automaton& dfa);
+
+        std::string serialize() const;
+    };
+
+    deterministic_automaton compile_dfa(
+        const nondeterministic_automaton& nfa,
+        const compile_options& options = {},
+        compile_stats* stats = nullptr
+    );
+}
+
+#endif
@@ -0,0 +1,327 @@
+#include "regex_derivative.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using namespace regexs;
+using expr = uint32_t;
+
+namespace {
+    // Nodes are looked up by kind, character set and children, so building an expression
+    // that already exists returns the existing one. The index holds only node IDs and
+    // hashes the nodes they refer to.
+    struct expression_pool {
+        enum kind : uint32_t {
+            NOTHING, EPSILON, CLASS, CONCAT, STAR, ALTERNATE
+        };
+
+        static constexpr expr NONE = 0;     // matches nothing
+        static constexpr expr EMPTY = 1;    // matches the empty string
+
+        struct node {
+            kind k;
+            uint32_t chars;
+            std::vector<expr> children;
+            bool nullable;
+        };
+
+        struct node_hash {
+            const std::vector<node>* nodes;
+            size_t operator()(expr e) const {
+                const node& n = (*nodes)[e];
+                size_t h = n.k * 31 + n.chars;
+                for (expr child : n.children) {
+                    h = h * 1000003 ^ child;
+                }
+                return h;
+            }
+        };
+        struct node_equal {
+            const std::vector<node>* nodes;
+            bool operator()(expr a, expr b) const {
+                const node& x = (*nodes)[a];
+                const node& y = (*nodes)[b];
+                return x.k == y.k && x.chars == y.chars && x.children == y.children;
+            }
+        };
+
+        std::vector<node> nodes;
+        std::unordered_set<expr, node_hash, node_equal> index{16, node_hash{&nodes}, node_equal{&nodes}};
+        std::vector<pattern_node::char_set> sets;
+        std::unordered_map<pattern_node::char_set, uint32_t> set_index;
+        std::unordered_map<uint64_t, expr> derivatives;
+        size_t bytes = 0;   // estimated, for max_dfa_bytes
+
+        static constexpr size_t NODE_OVERHEAD = 4 * sizeof(void*);
+
+        expression_pool() {
+            make(NOTHING, 0, {}, false);
+            make(EPSILON, 0, {}, true);
+        }
+
+        // The candidate is appended first so that the index can hash it, and dropped
+        // again if it already exists
+        expr make(kind k, uint32_t chars, std::vector<expr> children, bool nullable) {
+            size_t child_bytes = children.size() * sizeof(expr);
+            nodes.push_back(node{k, chars, std::move(children), nullable});
+            auto [it, inserted] = index.insert(static_cast<expr>(nodes.size() - 1));
+            if (inserted) {
+                bytes += sizeof(node) + child_bytes + sizeof(expr) + NODE_OVERHEAD;
+            } else {
+                nodes.pop_back();
+            }
+            return *it;
+        }
+
+        expr make_class(const pattern_node::char_set& cs) {
+            if (cs.none()) {
+                return NONE;
+            }
+            auto [it, inserted] = set_index.emplace(cs, static_cast<uint32_t>(sets.size()));
+            if (inserted) {
+                bytes += 2 * sizeof(pattern_node::char_set) + NODE_OVERHEAD;
+                sets.push_back(cs);
+            }
+            return make(CLASS, it->second, {}, false);
+        }
+
+        expr make_concat(expr a, expr b) {
+            if (a == NONE || b == NONE) return NONE;
+            if (a == EMPTY) return b;
+            if (b == EMPTY) return a;
+            if (nodes[a].k == CONCAT) {
+                expr head = nodes[a].children[0], rest = nodes[a].children[1];
+                return make_concat(head, make_concat(rest, b));
+            }
+            return make(CONCAT, 0, {a, b}, nodes[a].nullable && nodes[b].nullable);
+        }
+
+        expr make_star(expr a) {
+            if (a == NONE || a == EMPTY) return EMPTY;
+            if (nodes[a].k == STAR) return a;
+            return make(STAR, 0, {a}, true);
+        }
+
+        expr make_alternate(const std::vector<expr>& items) {
+            std::vector<expr> members;
+            pattern_node::char_set chars;
+            bool has_chars = false;
+            auto add = [&](expr e) {
+                if (e == NONE) return;
+                if (nodes[e].k == CLASS) {
+                    chars |= sets[nodes[e].chars];
+                    has_chars = true;
+                } else {
+                    members.push_back(e);
+                }
+            };
+            for (expr e : items) {
+                if (nodes[e].k == ALTERNATE) {
+                    for (expr child : nodes[e].children) add(child);
+                } else {
+                    add(e);
+                }
+            }
+            if (has_chars) {
+                members.push_back(make_class(chars));
+            }
+
+            std::sort(members.begin(), members.end());
+            members.erase(std::unique(members.begin(), members.end()), members.end());
+            // The empty string adds nothing next to a member that already matches it
+            bool nullable = false;
+            for (expr e : members) {
+                nullable = nullable || (e != EMPTY && nodes[e].nullable);
+            }
+            if (nullable && !members.empty() && members[0] == EMPTY) {
+                members.erase(members.begin());
+            }
+
+            if (members.empty()) return NONE;
+            if (members.size() == 1) return members[0];
+            return make(ALTERNATE, 0, members, nullable || members[0] == EMPTY);
+        }
+
+        expr from_pattern(const pattern_node& pn, bool case_insensitive) {
+            switch (pn.node_kind()) {
+            case pattern_node::EMPTY:
+                return EMPTY;
+            case pattern_node::LITERAL:
+                {
+                    expr e = EMPTY;
+                    for (size_t i = pn.text().size(); i > 0; i--) {
+                        pattern_node::char_set cs;
+                        unsigned char b = static_cast<unsigned char>(pn.text()[i - 1]);
+                        cs.set(b);
+                        if (case_insensitive && ((b >= 'a' && b <= 'z') || (b >= 'A' && b <= 'Z'))) {
+                            cs.set(b ^ 0x20);
+                        }
+                        e = make_concat(make_class(cs), e);
+                    }
+                    return e;
+                }
+            case pattern_node::CLASS:
+                return make_class(pn.chars());
+            case pattern_node::CONCAT:
+                {
+                    expr e = EMPTY;
+                    for (size_t i = pn.children().size(); i > 0; i--) {
+                        e = make_concat(from_pattern(*pn.children()[i - 1], case_insensitive), e);
+                    }
+                    return e;
+                }
+            case pattern_node::ALTERNATE:
+                {
+                    std::vector<expr> items;
+                    for (auto& child : pn.children()) {
+                        items.push_back(from_pattern(*child, case_insensitive));
+                    }
+                    return make_alternate(items);
+                }
+            case pattern_node::STAR:
+                return make_star(from_pattern(*pn.children()[0], case_insensitive));
+            case pattern_node::PLUS:
+                {
+                    expr e = from_pattern(*pn.children()[0], case_insensitive);
+                    return make_concat(e, make_star(e));
+                }
+            case pattern_node::OPTIONAL:
+                return make_alternate({EMPTY, from_pattern(*pn.children()[0], case_insensitive)});
+            }
+            return NONE;
+        }
+
+        // b stands for its whole byte class: every set in the pool, merged ones included,
+        // is a union of classes
+        expr derive(expr e, unsigned char b) {
+            uint64_t key = (static_cast<uint64_t>(e) << 8) | b;
+            auto it = derivatives.find(key);
+            if (it != derivatives.end()) {
+                return it->second;
+            }
+
+            expr d = NONE;
+            switch (nodes[e].k) {
+            case NOTHING:
+            case EPSILON:
+                break;
+            case CLASS:
+                d = sets[nodes[e].chars].test(b) ? EMPTY : NONE;
+                break;
+            case CONCAT:
+                {
+                    expr head = nodes[e].children[0], rest = nodes[e].children[1];
+                    d = make_concat(derive(head, b), rest);
+                    if (nodes[head].nullable) {
+                        d = make_alternate({d, derive(rest, b)});
+                    }
+                }
+                break;
+            case STAR:
+                d = make_concat(derive(nodes[e].children[0], b), e);
+                break;
+            case ALTERNATE:
+                {
+                    std::vector<expr> items = nodes[e].children;
+                    for (expr& item : items) {
+                        item = derive(item, b);
+                    }
+                    d = make_alternate(items);
+                }
+                break;
+            }
+            derivatives.emplace(key, d);
+            bytes += sizeof(std::pair<uint64_t, expr>) + NODE_OVERHEAD;
+            return d;
+        }
+
+        // Common refinement of every set; returns the bytes of each class
+        std::vector<std::vector<unsigned char>> byte_classes() const {
+            std::array<uint32_t, 256> cls{};
+            uint32_t count = 1;
+            for (const auto& cs : sets) {
+                std::unordered_map<uint64_t, uint32_t> split;
+                uint32_t next = 0;
+                for (size_t b = 0; b < 256; b++) {
+                    uint64_t key = (static_cast<uint64_t>(cls[b]) << 1) | cs.test(b);
+                    auto [it, inserted] = split.emplace(key, next);
+                    if (inserted) next++;
+                    cls[b] = it->second;
+                }
+                count = next;
+            }
+
+            std::vector<std::vector<unsigned char>> members(count);
+            for (size_t b = 0; b < 256; b++) {
+                members[cls[b]].push_back(static_cast<unsigned char>(b));
+            }
+            return members;
+        }
+    };
+}
+
+deterministic_automaton regexs::derivative_dfa(const pattern_node& node, const compile_options& options, compile_stats* stats) {
+    constexpr size_t node_overhead = expression_pool::NODE_OVERHEAD;
+    constexpr size_t transition_bytes = sizeof(std::pair<char, deterministic_automaton::state>) + node_overhead;
+    constexpr size_t state_bytes = sizeof(std::map<char, deterministic_automaton::state>) + sizeof(std::set<int>)
+                                 + sizeof(std::pair<expr, deterministic_automaton::state>) + node_overhead;
+
+    auto t0 = std::chrono::steady_clock::now();
+    expression_pool pool;
+    expr start = pool.from_pattern(node, options.case_insensitive);
+    std::vector<std::vector<unsigned char>> classes = pool.byte_classes();
+
+    deterministic_automaton dfa;
+    std::unordered_map<expr, deterministic_automaton::state> states{{start, dfa.start_state()}};
+    std::deque<expr> queue{start};
+    dfa.set_stop_state(dfa.start_state(), pool.nodes[start].nullable);
+    size_t bytes = state_bytes;
+
+    while (!queue.empty()) {
+        expr e = queue.front();
+        queue.pop_front();
+        deterministic_automaton::state from = states[e];
+
+        for (auto& members : classes) {
+            expr next = pool.derive(e, members[0]);
+            if (next == expression_pool::NONE) {
+                continue;
+            }
+
+            auto it = states.find(next);
+            if (it == states.end()) {
+                if (dfa.state_count() >= options.max_dfa_states) {
+                    throw budget_exceeded("derivative construction exceeded the DFA state budget");
+                }
+                it = states.emplace(next, dfa.add_state()).first;
+                dfa.set_stop_state(it->second, pool.nodes[next].nullable);
+                queue.push_back(next);
+                bytes += state_bytes;
+            }
+            for (unsigned char b : members) {
+                dfa.set_jump(from, static_cast<char>(b), it->second);
+            }
+            bytes += members.size() * transition_bytes;
+        }
+
+        if (bytes + pool.bytes > options.max_dfa_bytes) {
+            throw budget_exceeded("derivative construction exceeded the DFA memory budget");
+        }
+    }
+    auto t1 = std::chrono::steady_clock::now();
+
+    if (stats != nullptr) {
+        stats->dfa_states_raw = dfa.state_count();
+        stats->record_dfa(dfa);
+        stats->derivative_expressions = pool.nodes.size();
+        stats->derivative_time = t1 - t0;
+    }
+    return dfa;
+}
@@ -0,0 +1,26 @@
+#ifndef REGEX_DERIVATIVE_HPP
+#define REGEX_DERIVATIVE_HPP
+
+#include "regex_ast.hpp"
+#include "regex_compile.hpp"
+#include "regex_dfa.hpp"
+
+namespace regexs {
+    // Builds the DFA of a pattern from its Brzozowski derivatives, without an NFA. Every
+    // state is an expression, hash-consed so that equal expressions are one state, and
+    // kept in a normal form: alternations are flattened, sorted and deduplicated (ACI),
+    // with their character classes merged, and concatenations nest to the right. The
+    // normal form is not complete, so the DFA may have a few more states than the
+    // minimal one, but no simplify pass is run on it.
+    //
+    // Derivatives are taken once per byte class, the classes being the common
+    // refinement of every character set in the pattern. Honors max_dfa_states and
+    // max_dfa_bytes like compile_dfa.
+    deterministic_automaton derivative_dfa(
+        const pattern_node& node,
+        const compile_options& options = {},
+        compile_stats* stats = nullptr
+    );
+}
+
+#endif
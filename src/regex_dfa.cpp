@@ -1,5 +1,6 @@
 
 #include "regex_dfa.hpp"
+#include <deque>
 #include <map>
 #include <sstream>
 #include <utility>
@@ -16,6 +17,80 @@ state deterministic_automaton::add_state() {
     return state_map.size() - 1;
 }
 
+size_t deterministic_automaton::transition_count() const {
+    size_t count = 0;
+    for (auto& smap : state_map) {
+        count += smap.size();
+    }
+    return count;
+}
+
+// Estimated heap bytes of the transition rows, counting one tree node per transition
+size_t deterministic_automaton::memory_usage() const {
+    constexpr size_t node_size = sizeof(std::map<char, state>::value_type) + 4 * sizeof(void*);
+    return state_map.capacity() * sizeof(std::map<char, state>) + transition_count() * node_size;
+}
+
+// Bytes that every state sends to the same target share a class. Classes are
+// numbered in order of their smallest byte; returns the number of classes.
+//
+// Columns are grouped by a hash first and the grouping is then checked row by row;
+// only a hash collision falls back to comparing whole columns.
+size_t deterministic_automaton::byte_classes(byte_class_map& classes) const {
+    std::array<state, 256> row;
+    std::array<size_t, 256> hashes;
+    hashes.fill(0);
+    for (state s = 0; s < state_count(); s++) {
+        row.fill(REJECT);
+        for (auto [ch, to] : state_map[s]) {
+            row[static_cast<unsigned char>(ch)] = to;
+        }
+        for (int b = 0; b < 256; b++) {
+            hashes[b] = (hashes[b] ^ row[b]) * 0x100000001b3ULL;
+        }
+    }
+
+    std::map<size_t, unsigned char> hash_classes;
+    std::array<unsigned char, 256> representative;
+    for (int b = 0; b < 256; b++) {
+        auto [it, inserted] = hash_classes.emplace(hashes[b], static_cast<unsigned char>(hash_classes.size()));
+        classes[b] = it->second;
+        if (inserted) {
+            representative[it->second] = static_cast<unsigned char>(b);
+        }
+    }
+
+    bool collided = false;
+    for (state s = 0; s < state_count() && !collided; s++) {
+        row.fill(REJECT);
+        for (auto [ch, to] : state_map[s]) {
+            row[static_cast<unsigned char>(ch)] = to;
+        }
+        for (int b = 0; b < 256; b++) {
+            if (row[b] != row[representative[classes[b]]]) {
+                collided = true;
+                break;
+            }
+        }
+    }
+    if (!collided) {
+        return hash_classes.size();
+    }
+
+    std::map<std::vector<state>, unsigned char> signatures;
+    std::vector<state> signature(state_count());
+    for (int b = 0; b < 256; b++) {
+        char ch = static_cast<char>(b);
+        for (state s = 0; s < state_count(); s++) {
+            auto it = state_map[s].find(ch);
+            signature[s] = (it == state_map[s].end()) ? REJECT : it->second;
+        }
+        auto [it, inserted] = signatures.emplace(signature, static_cast<unsigned char>(signatures.size()));
+        classes[b] = it->second;
+    }
+    return signatures.size();
+}
+
 state deterministic_automaton::start_state() const {
     return __start_state;
 }
@@ -74,6 +149,64 @@ std::pair<state, std::set<state>> deterministic_automaton::import_automaton(cons
 }
 
 
+// Product construction: accepts what either automaton accepts, and a product state
+// carries the marks of both halves. Throws budget_exceeded past max_states.
+deterministic_automaton deterministic_automaton::unite(const deterministic_automaton& atm, size_t max_states) const {
+    deterministic_automaton both = *this;
+    auto [other_start, other_stops] = both.import_automaton(atm);
+    both.__end_states.insert(other_stops.begin(), other_stops.end());
+
+    auto next_of = [&](state s, char ch) {
+        return (s == REJECT) ? REJECT : both.next_state(s, ch);
+    };
+    auto is_stop_of = [&](state s) {
+        return s != REJECT && both.is_stop_state(s);
+    };
+
+    deterministic_automaton product;
+    std::map<std::pair<state, state>, state> state_translate;
+    std::deque<std::pair<state, state>> state_queue;
+
+    std::pair<state, state> start_pair(__start_state, other_start);
+    state_translate[start_pair] = product.start_state();
+    state_queue.push_back(start_pair);
+
+    while (!state_queue.empty()) {
+        auto [s1, s2] = state_queue.front();
+        state_queue.pop_front();
+        state pst = state_translate[{s1, s2}];
+
+        product.set_stop_state(pst, is_stop_of(s1) || is_stop_of(s2));
+        for (state s : {s1, s2}) {
+            if (s != REJECT) {
+                product.state_marks[pst].insert(both.state_marks[s].begin(), both.state_marks[s].end());
+            }
+        }
+
+        std::set<char> transitions;
+        for (state s : {s1, s2}) {
+            if (s == REJECT) continue;
+            for (auto& [ch, target] : both.state_map[s]) {
+                transitions.insert(ch);
+            }
+        }
+
+        for (char ch : transitions) {
+            std::pair<state, state> next_pair(next_of(s1, ch), next_of(s2, ch));
+            auto it = state_translate.find(next_pair);
+            if (it == state_translate.end()) {
+                if (product.state_count() >= max_states) {
+                    throw budget_exceeded("product construction exceeded the DFA state budget");
+                }
+                it = state_translate.emplace(next_pair, product.add_state()).first;
+                state_queue.push_back(next_pair);
+            }
+            product.set_jump(pst, ch, it->second);
+        }
+    }
+
+    return product;
+}
 
 void deterministic_automaton::simplify() {
     class dsu {
@@ -93,15 +226,20 @@ void deterministic_automaton::simplify() {
     dsu equivalence(state_count());
     std::map<std::set<int>, state> mark_states;
 
+    state plain_root = REJECT;
     for (state s = 0; s < state_count(); s++) {
+        equivalence.reset(s);
         if (is_stop_state(s)) {
-            equivalence.reset(s);
             std::set<int> mark = state_mark(s);
             if (mark_states.count(mark)) {
                 equivalence.link(s, mark_states[mark]);
             } else {
                 mark_states[state_mark(s)] = s;
             }
+        } else if (plain_root == REJECT) {
+            plain_root = s;
+        } else {
+            equivalence.link(s, plain_root);
         }
     }
 
@@ -1,22 +1,33 @@
 #ifndef REGEX_DFA_HPP
 #define REGEX_DFA_HPP
 
+#include <array>
 #include <string>
 #include <limits>
+#include <stdexcept>
 #include <set>
 #include <utility>
 #include <vector>
 #include <map>
 
 namespace regexs {
+    class budget_exceeded : public std::runtime_error {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
     class deterministic_automaton {
     public:
         using state = size_t;
-        const state REJECT = std::numeric_limits<size_t>::max();
+        static constexpr state REJECT = std::numeric_limits<size_t>::max();
+        using byte_class_map = std::array<unsigned char, 256>;
 
         deterministic_automaton();
 
         inline size_t state_count() const { return state_map.size(); }
+        size_t transition_count() const;
+        size_t memory_usage() const;
+        size_t byte_classes(byte_class_map& classes) const;
 
         state add_state();
         state start_state() const;
@@ -30,8 +41,13 @@ namespace regexs {
         const std::set<int>& state_mark(state s) const;
 
         std::pair<state, std::set<state>> import_automaton(const deterministic_automaton& atm);
+        deterministic_automaton unite(
+            const deterministic_automaton& atm,
+            size_t max_states = std::numeric_limits<size_t>::max()
+        ) const;
 
         void simplify();
+        void parallel_simplify(size_t threads);
 
         std::string serialize() const;
     private:
@@ -0,0 +1,159 @@
+#include "regex_input.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace regexs;
+
+std::unique_ptr<line_reader> line_reader::open(const std::string& path) {
+    if (path == "-") {
+        return std::make_unique<line_reader>(STDIN_FILENO, false);
+    }
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    return std::make_unique<line_reader>(fd, true);
+}
+
+line_reader::line_reader(int fd, bool owns_fd) :
+    __fd(fd),
+    __owns_fd(owns_fd),
+    __failed(false),
+    __ring(RING_BUFFERS),
+    __free(RING_BUFFERS),
+    __holding(false),
+    __done(false),
+    __stop(false),
+    __consumer_waiting(false)
+{
+    __reader = std::thread(&line_reader::read_ahead, this);
+}
+
+line_reader::~line_reader() {
+    {
+        std::lock_guard<std::mutex> guard(__mutex);
+        __stop = true;
+    }
+    __free_cv.notify_one();
+    __reader.join();
+    if (__owns_fd) {
+        ::close(__fd);
+    }
+}
+
+bool line_reader::next(std::string_view& block) {
+    std::unique_lock<std::mutex> lock(__mutex);
+    if (__holding) {
+        __ready.pop_front();
+        __free++;
+        __holding = false;
+        __free_cv.notify_one();
+    }
+
+    __consumer_waiting = true;
+    __ready_cv.wait(lock, [&] { return !__ready.empty() || __done; });
+    __consumer_waiting = false;
+    if (__ready.empty()) {
+        return false;
+    }
+
+    buffer& buf = __ring[__ready.front()];
+    __holding = true;
+    block = std::string_view(buf.data.data(), buf.lines);
+    return true;
+}
+
+// Buffers are taken in ring order, which is also the order the consumer hands them
+// back in, so a free count is enough to know the next one is no longer in use
+void line_reader::read_ahead() {
+    size_t index = 0;
+    const buffer* prev = nullptr;
+    size_t prev_filled = 0;
+    bool eof = false;
+
+    while (!eof) {
+        {
+            std::unique_lock<std::mutex> lock(__mutex);
+            __free_cv.wait(lock, [&] { return __free > 0 || __stop; });
+            if (__stop) {
+                return;
+            }
+            __free--;
+        }
+
+        buffer& buf = __ring[index];
+        size_t tail = (prev != nullptr) ? prev_filled - prev->lines : 0;
+        if (buf.data.size() < std::max(BUFFER_BYTES, tail * 2)) {
+            buf.data.resize(std::max(BUFFER_BYTES, tail * 2));
+        }
+        if (tail > 0) {
+            std::memcpy(buf.data.data(), prev->data.data() + prev->lines, tail);
+        }
+
+        size_t filled = tail;
+        if (!fill(buf, filled, eof)) {
+            __failed = true;
+            eof = true;
+        }
+
+        if (eof) {
+            buf.lines = filled;
+        } else {
+            const void* last = memrchr(buf.data.data(), LINE_DELIMITER, filled);
+            buf.lines = static_cast<const char*>(last) - buf.data.data() + 1;
+        }
+
+        std::lock_guard<std::mutex> guard(__mutex);
+        if (buf.lines == 0) {
+            __free++;
+        } else {
+            __ready.push_back(index);
+            __ready_cv.notify_one();
+            prev = &buf;
+            prev_filled = filled;
+            index = (index + 1) % RING_BUFFERS;
+        }
+    }
+
+    std::lock_guard<std::mutex> guard(__mutex);
+    __done = true;
+    __ready_cv.notify_one();
+}
+
+// Reads until the buffer is full or, once it holds a whole line, until the matcher
+// runs dry, so that slow producers are not held back for a full buffer. A line that
+// does not fit makes the buffer grow. The carried tail holds no delimiter, so only
+// the bytes read here are searched for one.
+bool line_reader::fill(buffer& buf, size_t& filled, bool& eof) {
+    bool has_line = false;
+    while (true) {
+        if (filled == buf.data.size()) {
+            if (has_line) {
+                return true;
+            }
+            buf.data.resize(buf.data.size() * 2);
+        }
+
+        ssize_t n = ::read(__fd, buf.data.data() + filled, buf.data.size() - filled);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (n == 0) {
+            eof = true;
+            return true;
+        }
+        has_line = has_line || std::memchr(buf.data.data() + filled, LINE_DELIMITER, n) != nullptr;
+        filled += n;
+
+        if (has_line && __consumer_waiting) {
+            return true;
+        }
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef REGEX_INPUT_HPP
+#define REGEX_INPUT_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace regexs {
+    // Input of the grep front end, handed out as blocks of whole lines so that every
+    // block can go straight to scan_lines. A thread reads ahead into a ring of large
+    // buffers while the previous blocks are being matched; the unfinished line at the
+    // end of a buffer is the only thing copied, to the front of the next one.
+    //
+    // Regular files take the same path: faulting in a mapping page by page turned out
+    // slower than reading into buffers that stay in cache.
+    class line_reader {
+    public:
+        static constexpr size_t BUFFER_BYTES = 1 << 20;
+        static constexpr size_t RING_BUFFERS = 4;
+        static constexpr char LINE_DELIMITER = '\n';
+
+        // "-" is standard input. Returns nullptr if the file cannot be opened.
+        static std::unique_ptr<line_reader> open(const std::string& path);
+
+        explicit line_reader(int fd, bool owns_fd);
+        line_reader(const line_reader&) = delete;
+        line_reader& operator=(const line_reader&) = delete;
+        ~line_reader();
+
+        // A read failed; the blocks before it were still handed out
+        inline bool failed() const { return __failed; }
+
+        // The next block, valid until the following call. The last block may lack a
+        // final delimiter. Returns false at the end of the input.
+        bool next(std::string_view& block);
+    private:
+        struct buffer {
+            std::vector<char> data;
+            size_t lines;       // bytes up to and including the last delimiter handed out
+        };
+
+        int __fd;
+        bool __owns_fd;
+        bool __failed;
+        std::vector<buffer> __ring;
+        std::deque<size_t> __ready;
+        size_t __free;
+        bool __holding;
+        bool __done;
+        bool __stop;
+        std::atomic<bool> __consumer_waiting;
+        std::mutex __mutex;
+        std::condition_variable __ready_cv;
+        std::condition_variable __free_cv;
+        std::thread __reader;
+
+        void read_ahead();
+        bool fill(buffer& buf, size_t& filled, bool& eof);
+    };
+}
+
+#endif
@@ -0,0 +1,301 @@
+#include "regex_literal.hpp"
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace regexs;
+using node = literal_set::node;
+
+// Reports the line around a match ending at end, and returns where scanning resumes
+static size_t report_line(std::string_view buffer, size_t line_floor, size_t end, const transition_table::line_callback& on_line) {
+    size_t last = buffer.substr(line_floor, end - line_floor).rfind(transition_table::LINE_DELIMITER);
+    size_t line_begin = (last == std::string_view::npos) ? line_floor : line_floor + last + 1;
+    size_t line_end = buffer.find(transition_table::LINE_DELIMITER, end);
+    if (line_end == std::string_view::npos) {
+        line_end = buffer.size();
+    }
+    on_line(line_begin, line_end);
+    return line_end + 1;
+}
+
+literal_searcher::literal_searcher(std::string needle) : __needle(std::move(needle)) {
+    if (__needle.size() >= 2) {
+        __fallback.emplace(std::vector<std::string>{__needle});
+    }
+}
+
+size_t literal_searcher::find(std::string_view haystack, size_t from) const {
+    size_t m = __needle.size();
+    if (m < 2 || from > haystack.size()) {
+        return haystack.find(__needle, from);
+    }
+
+    auto search_from = [&](size_t at) {
+        auto found = __fallback->search(haystack.substr(at));
+        return found ? at + found->first : std::string_view::npos;
+    };
+
+#ifdef __SSE2__
+    const char* h = haystack.data();
+    const char* n = __needle.data();
+    __m128i first = _mm_set1_epi8(n[0]);
+    __m128i last = _mm_set1_epi8(n[m - 1]);
+    size_t checked = 0;
+    size_t i = from;
+    for (; i + m - 1 + 16 <= haystack.size(); i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(h + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(h + i + m - 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        while (mask != 0) {
+            size_t at = i + __builtin_ctz(mask);
+            if ((checked += m - 2) > at - from + m) {
+                return search_from(at);
+            }
+            if (std::memcmp(h + at + 1, n + 1, m - 2) == 0) {
+                return at;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return search_from(i);
+#else
+    return search_from(from);
+#endif
+}
+
+// The needle must not contain the line delimiter
+void literal_searcher::scan_lines(std::string_view buffer, const transition_table::line_callback& on_line) const {
+    size_t line_floor = 0;
+    size_t at;
+    while (line_floor < buffer.size() && (at = find(buffer, line_floor)) != std::string_view::npos) {
+        line_floor = report_line(buffer, line_floor, at + __needle.size(), on_line);
+    }
+}
+
+struct literal_set::dense_step {
+    const literal_set& set;
+
+    inline node operator()(node s, char ch) const {
+        return set.__dense[s * set.__class_count + set.__classes[static_cast<unsigned char>(ch)]];
+    }
+};
+
+struct literal_set::sparse_step {
+    const literal_set& set;
+
+    // Children are numbered consecutively in byte order, so a child's ID is the rank of
+    // its bit in the bitmap past the first one
+    inline node child(node s, unsigned char b) const {
+        const sparse_node& n = set.__sparse[s];
+        uint64_t bit = uint64_t(1) << (b & 63);
+        uint64_t word = n.bits[b >> 6];
+        if ((word & bit) == 0) {
+            return ROOT;
+        }
+        size_t rank = __builtin_popcountll(word & (bit - 1));
+        for (size_t i = 0; i < (b >> 6); i++) {
+            rank += __builtin_popcountll(n.bits[i]);
+        }
+        return n.first_child + rank;
+    }
+
+    inline node operator()(node s, char ch) const {
+        unsigned char b = set.__fold[static_cast<unsigned char>(ch)];
+        for (;;) {
+            node c = child(s, b);
+            if (c != ROOT || s == ROOT) return c;
+            s = set.__sparse[s].fail;
+        }
+    }
+};
+
+template <typename F>
+auto literal_set::with_step(F&& f) const {
+    if (is_dense()) {
+        return f(dense_step{*this});
+    }
+    return f(sparse_step{*this});
+}
+
+// Nodes are numbered breadth-first, so parents and failure targets precede their nodes
+// and the children of a node are consecutive.
+literal_set::literal_set(const std::vector<std::string>& words, bool case_insensitive) : __class_count(1) {
+    for (size_t c = 0; c < 256; c++) {
+        __fold[c] = (case_insensitive && c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+    }
+
+    std::vector<std::map<unsigned char, node>> trie(1);
+    std::vector<bool> trie_terminal(1, false);
+    for (auto& word : words) {
+        node s = ROOT;
+        for (char ch : word) {
+            unsigned char b = __fold[static_cast<unsigned char>(ch)];
+            auto it = trie[s].find(b);
+            if (it == trie[s].end()) {
+                node next = trie.size();
+                trie[s].emplace(b, next);
+                trie.emplace_back();
+                trie_terminal.push_back(false);
+                s = next;
+            } else {
+                s = it->second;
+            }
+        }
+        trie_terminal[s] = (s != ROOT);
+    }
+
+    size_t n = trie.size();
+    std::vector<node> order{ROOT};
+    for (size_t i = 0; i < order.size(); i++) {
+        for (auto& kv : trie[order[i]]) order.push_back(kv.second);
+    }
+    std::vector<node> label(n);
+    for (size_t i = 0; i < n; i++) {
+        label[order[i]] = i;
+    }
+
+    std::vector<std::vector<std::pair<unsigned char, node>>> kids(n);
+    std::vector<bool> terminal(n);
+    for (size_t old = 0; old < n; old++) {
+        for (auto& kv : trie[old]) kids[label[old]].emplace_back(kv.first, label[kv.second]);
+        terminal[label[old]] = trie_terminal[old];
+    }
+    trie.clear();
+
+    auto child = [&](node s, unsigned char b) -> node {
+        auto it = std::lower_bound(kids[s].begin(), kids[s].end(), std::make_pair(b, node(0)));
+        return (it != kids[s].end() && it->first == b) ? it->second : ROOT;
+    };
+
+    std::vector<node> fail(n, ROOT);
+    __depth.assign(n, 0);
+    __out_len.assign(n, 0);
+    for (node u = 0; u < n; u++) {
+        for (auto& [b, v] : kids[u]) {
+            __depth[v] = __depth[u] + 1;
+            if (u != ROOT) {
+                node f = fail[u];
+                for (;;) {
+                    node c = child(f, b);
+                    if (c != ROOT || f == ROOT) {
+                        fail[v] = c;
+                        break;
+                    }
+                    f = fail[f];
+                }
+            }
+            __out_len[v] = terminal[v] ? __depth[v] : __out_len[fail[v]];
+        }
+    }
+
+    // Class 0 holds every byte no word contains
+    std::array<unsigned char, 256> folded_class{};
+    std::vector<unsigned char> class_byte{0};
+    for (auto& ks : kids) {
+        for (auto& kv : ks) {
+            if (folded_class[kv.first] == 0) {
+                folded_class[kv.first] = class_byte.size();
+                class_byte.push_back(kv.first);
+            }
+        }
+    }
+    __class_count = class_byte.size();
+    for (size_t c = 0; c < 256; c++) {
+        __classes[c] = folded_class[__fold[c]];
+    }
+
+    if (n * __class_count * sizeof(node) <= DENSE_BUDGET) {
+        __dense.assign(n * __class_count, ROOT);
+        for (node s = 0; s < n; s++) {
+            for (size_t k = 1; k < __class_count; k++) {
+                node c = child(s, class_byte[k]);
+                if (c == ROOT && s != ROOT) {
+                    c = __dense[fail[s] * __class_count + k];
+                }
+                __dense[s * __class_count + k] = c;
+            }
+        }
+    } else {
+        __sparse.resize(n);
+        for (node s = 0; s < n; s++) {
+            sparse_node& sn = __sparse[s];
+            std::fill(std::begin(sn.bits), std::end(sn.bits), 0);
+            for (auto& kv : kids[s]) {
+                sn.bits[kv.first >> 6] |= uint64_t(1) << (kv.first & 63);
+            }
+            sn.first_child = kids[s].empty() ? ROOT : kids[s].front().second;
+            sn.fail = fail[s];
+        }
+    }
+}
+
+size_t literal_set::memory_usage() const {
+    return __dense.size() * sizeof(node) + __sparse.size() * sizeof(sparse_node)
+        + (__depth.size() + __out_len.size()) * sizeof(uint32_t);
+}
+
+// A walk that never took a failure link is exactly as deep as the input consumed
+bool literal_set::match(std::string_view sv) const {
+    return with_step([&](auto step) {
+        node s = ROOT;
+        for (size_t i = 0; i < sv.size(); i++) {
+            s = step(s, sv[i]);
+            if (__depth[s] != i + 1) return false;
+        }
+        return !sv.empty() && __out_len[s] == __depth[s];
+    });
+}
+
+std::optional<std::pair<size_t, size_t>> literal_set::search(std::string_view sv) const {
+    return with_step([&](auto step) -> std::optional<std::pair<size_t, size_t>> {
+        node s = ROOT;
+        for (size_t i = 0; i < sv.size(); i++) {
+            s = step(s, sv[i]);
+            if (__out_len[s] != 0) {
+                return std::make_pair(i + 1 - __out_len[s], i + 1);
+            }
+        }
+        return std::nullopt;
+    });
+}
+
+std::optional<size_t> literal_set::prefix(std::string_view sv) const {
+    return with_step([&](auto step) -> std::optional<size_t> {
+        node s = ROOT;
+        for (size_t i = 0; i < sv.size(); i++) {
+            s = step(s, sv[i]);
+            if (__depth[s] != i + 1) break;
+            if (__out_len[s] == __depth[s]) return i + 1;
+        }
+        return std::nullopt;
+    });
+}
+
+size_t literal_set::longest_suffix(std::string_view sv) const {
+    return with_step([&](auto step) -> size_t {
+        node s = ROOT;
+        for (char ch : sv) {
+            s = step(s, ch);
+        }
+        return __out_len[s];
+    });
+}
+
+// No word may contain the line delimiter, so a match never spans two lines
+void literal_set::scan_lines(std::string_view buffer, const transition_table::line_callback& on_line) const {
+    with_step([&](auto step) {
+        node s = ROOT;
+        size_t line_floor = 0;
+        for (size_t i = 0; i < buffer.size(); ) {
+            s = step(s, buffer[i++]);
+            if (__out_len[s] != 0) {
+                i = line_floor = report_line(buffer, line_floor, i, on_line);
+                s = ROOT;
+            }
+        }
+    });
+}
@@ -0,0 +1,84 @@
+#ifndef REGEX_LITERAL_HPP
+#define REGEX_LITERAL_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "regex_table.hpp"
+
+namespace regexs {
+    // Aho-Corasick automaton over a set of non-empty fixed strings. Small sets fold the
+    // failure links into a dense table over the bytes that occur in the words; large ones
+    // keep a 256-bit child bitmap per node and follow failure links while scanning.
+    // With case_insensitive set, ASCII letters are folded on both sides.
+    class literal_set {
+    public:
+        using node = uint32_t;
+
+        static constexpr size_t DENSE_BUDGET = 1024 * 1024;
+
+        literal_set(const std::vector<std::string>& words, bool case_insensitive = false);
+
+        inline size_t node_count() const { return __depth.size(); }
+        inline bool is_dense() const { return !__dense.empty(); }
+        size_t memory_usage() const;
+
+        // The whole input is one of the words
+        bool match(std::string_view sv) const;
+        // The match ending first, and the longest of those
+        std::optional<std::pair<size_t, size_t>> search(std::string_view sv) const;
+        // End of the shortest word the input starts with
+        std::optional<size_t> prefix(std::string_view sv) const;
+        // Length of the longest word the input ends with, 0 if none
+        size_t longest_suffix(std::string_view sv) const;
+        void scan_lines(std::string_view buffer, const transition_table::line_callback& on_line) const;
+    private:
+        struct sparse_node {
+            uint64_t bits[4];
+            node first_child;
+            node fail;
+        };
+        struct dense_step;
+        struct sparse_step;
+
+        static constexpr node ROOT = 0;
+
+        std::array<unsigned char, 256> __fold;
+        std::array<unsigned char, 256> __classes;
+        size_t __class_count;
+        std::vector<node> __dense;
+        std::vector<sparse_node> __sparse;
+        std::vector<uint32_t> __depth;
+        std::vector<uint32_t> __out_len;    // longest word ending at this node
+
+        template <typename F>
+        auto with_step(F&& f) const;
+    };
+
+    // Finds one fixed string. Candidates are picked 16 positions at a time by comparing
+    // the first and last byte of the needle, then checked with memcmp. Once checking has
+    // cost more than the bytes scanned plus one needle, and for the last bytes of the
+    // input, the search goes on with a one-word literal_set, so a call is O(n + m) even
+    // for needles like aaaab over runs of a.
+    class literal_searcher {
+    public:
+        explicit literal_searcher(std::string needle);
+
+        inline const std::string& needle() const { return __needle; }
+
+        // Position of the first occurrence at or after from, or npos
+        size_t find(std::string_view haystack, size_t from = 0) const;
+        void scan_lines(std::string_view buffer, const transition_table::line_callback& on_line) const;
+    private:
+        std::string __needle;
+        std::optional<literal_set> __fallback;     // needles of two bytes or more
+    };
+}
+
+#endif
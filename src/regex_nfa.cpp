@@ -1,5 +1,8 @@
+#include <climits>
+#include <deque>
+#include <map>
 #include <sstream>
-#include <stack>
+#include <vector>
 #include "regex_nfa.hpp"
 
 using namespace regexs;
@@ -37,6 +40,22 @@ nondeterministic_automaton::single_state nondeterministic_automaton::add_state()
     return nodes.size() - 1;
 }
 
+size_t nondeterministic_automaton::edge_count() const {
+    size_t count = 0;
+    for (const state_node& node : nodes) {
+        count += node.next.size() + node.eps_next.size();
+    }
+    return count;
+}
+
+size_t nondeterministic_automaton::epsilon_edge_count() const {
+    size_t count = 0;
+    for (const state_node& node : nodes) {
+        count += node.eps_next.size();
+    }
+    return count;
+}
+
 void nondeterministic_automaton::add_jump(single_state from, char ch, single_state to) {
     nodes[from].next.insert(std::make_pair(ch, to));
 }
@@ -54,19 +73,16 @@ nondeterministic_automaton::state nondeterministic_automaton::epsilon_closure(si
 }
 
 nondeterministic_automaton::state nondeterministic_automaton::epsilon_closure(state states) const {
-    std::stack<single_state> search_stack;
-    for (single_state s : states) {
-        search_stack.push(s);
-    }
+    std::pmr::vector<single_state> search_stack(states.begin(), states.end(), compile_arena::current());
 
     while (!search_stack.empty()) {
-        single_state st = search_stack.top();
-        search_stack.pop();
+        single_state st = search_stack.back();
+        search_stack.pop_back();
 
         for (single_state next : nodes[st].eps_next) {
             if (!states.count(next)) {
                 states.insert(next);
-                search_stack.push(next);
+                search_stack.push_back(next);
             }
         }
     }
@@ -201,7 +217,14 @@ void nondeterministic_automaton::refactor_to_skippable() {
         return;
     }
 
-    add_epsilon_jump(start_sstate, *stop_sstates.begin());
+    // Loops through the old start or stop state must not become skippable as well
+    single_state new_start = add_state(), new_stop = add_state();
+    add_epsilon_jump(new_start, start_sstate);
+    add_epsilon_jump(*stop_sstates.begin(), new_stop);
+    add_epsilon_jump(new_start, new_stop);
+
+    start_sstate = new_start;
+    stop_sstates = {new_stop};
 }
 
 void nondeterministic_automaton::connect(const nondeterministic_automaton& atm) {
@@ -214,9 +237,47 @@ void nondeterministic_automaton::connect(const nondeterministic_automaton& atm)
 }
 
 void nondeterministic_automaton::make_origin_branch(const nondeterministic_automaton& m2) {
+    single_state new_start = add_state();
+    add_epsilon_jump(new_start, start_sstate);
+    start_sstate = new_start;
+
     add_automaton(start_sstate, m2);
 }
 
+void nondeterministic_automaton::refactor_to_unanchored() {
+    single_state new_start = add_state();
+    for (int ch = CHAR_MIN; ch <= CHAR_MAX; ch++) {
+        add_jump(new_start, static_cast<char>(ch), new_start);
+    }
+    add_epsilon_jump(new_start, start_sstate);
+    start_sstate = new_start;
+}
+
+// Accepts exactly the reversed strings. State marks are not carried over.
+nondeterministic_automaton nondeterministic_automaton::reverse() const {
+    nondeterministic_automaton atm;
+    single_state bias = atm.nodes.size();
+    for (single_state s = 0; s < state_count(); s++) {
+        atm.add_state();
+    }
+
+    for (single_state s = 0; s < state_count(); s++) {
+        for (auto [ch, st] : nodes[s].next) {
+            atm.add_jump(st + bias, ch, s + bias);
+        }
+        for (auto st : nodes[s].eps_next) {
+            atm.add_epsilon_jump(st + bias, s + bias);
+        }
+    }
+
+    for (single_state s : stop_sstates) {
+        atm.add_epsilon_jump(atm.start_sstate, s + bias);
+    }
+    atm.set_stop_state(start_sstate + bias);
+
+    return atm;
+}
+
 template <typename T>
 static std::string serialize_set(const std::set<T>& val) {
     if (val.size() == 0) {
@@ -244,18 +305,39 @@ static std::string serialize_set(const std::set<T>& val) {
 }
 
 deterministic_automaton nondeterministic_automaton::to_deterministic() const {
+    deterministic_automaton atm = subset_construction();
+    atm.simplify();
+    return atm;
+}
+
+// Throws budget_exceeded once the DFA grows past max_states, or once the estimated
+// bytes held by the DFA rows and the subset table grow past max_bytes. All subsets
+// live in a compile_arena that is dropped as a whole on return.
+deterministic_automaton nondeterministic_automaton::subset_construction(size_t max_states, size_t max_bytes) const {
+    constexpr size_t node_overhead = 4 * sizeof(void*);
+    constexpr size_t transition_bytes = sizeof(std::pair<char, deterministic_automaton::state>) + node_overhead;
+    constexpr size_t subset_entry_bytes = sizeof(single_state) + node_overhead;
+    constexpr size_t state_bytes = sizeof(std::map<char, deterministic_automaton::state>) + sizeof(std::set<int>)
+                                 + sizeof(std::pair<state, deterministic_automaton::state>) + node_overhead;
+
     const nondeterministic_automaton &nfa = *this;
 
+    compile_arena arena;
+    compile_arena::scope in_arena(arena);
+
     deterministic_automaton atm;
 
     nondeterministic_automaton::state nfa_state = nfa.start_state();
 
-    std::map<nondeterministic_automaton::state, deterministic_automaton::state> state_translate;
+    std::pmr::map<nondeterministic_automaton::state, deterministic_automaton::state> state_translate(arena.resource());
     state_translate[nfa_state] = atm.start_state();
+    atm.set_stop_state(atm.start_state(), nfa.is_stop_state(nfa_state));
 
-    std::deque<nondeterministic_automaton::state> state_queue;
+    std::pmr::deque<nondeterministic_automaton::state> state_queue(arena.resource());
     state_queue.push_back(nfa_state);
 
+    size_t bytes = state_bytes + nfa_state.size() * subset_entry_bytes;
+
     while (!state_queue.empty()) {
         nondeterministic_automaton::state& st = state_queue.front();
         deterministic_automaton::state fst = state_translate[st];
@@ -264,6 +346,10 @@ deterministic_automaton nondeterministic_automaton::to_deterministic() const {
             nondeterministic_automaton::state next_st = st.next_state(ch);
             deterministic_automaton::state next_fst;
             if (!state_translate.count(next_st)) {
+                bytes += state_bytes + next_st.size() * subset_entry_bytes;
+                if (atm.state_count() >= max_states) {
+                    throw budget_exceeded("subset construction exceeded the DFA state budget");
+                }
                 next_fst = state_translate[next_st] = atm.add_state();
                 atm.set_stop_state(next_fst, nfa.is_stop_state(next_st));
                 state_queue.push_back(next_st);
@@ -271,6 +357,11 @@ deterministic_automaton nondeterministic_automaton::to_deterministic() const {
                 next_fst = state_translate[next_st];
             }
             atm.set_jump(fst, ch, next_fst);
+
+            bytes += transition_bytes;
+            if (bytes > max_bytes) {
+                throw budget_exceeded("subset construction exceeded the DFA memory budget");
+            }
         }
 
         state_queue.pop_front();
@@ -283,8 +374,6 @@ deterministic_automaton nondeterministic_automaton::to_deterministic() const {
         }
     }
 
-    atm.simplify();
-
     return atm;
 }
 
@@ -2,11 +2,14 @@
 #define REGEX_NFA_HPP
 
 #include <initializer_list>
+#include <limits>
+#include <memory_resource>
 #include <vector>
 #include <string>
 #include <map>
 #include <set>
 
+#include "regex_arena.hpp"
 #include "regex_dfa.hpp"
 
 
@@ -15,18 +18,27 @@ namespace regexs {
     public:
         using single_state = size_t;
         
-        class state : private std::set<single_state> {
+        // Subsets allocate from the current compile_arena, copies included
+        class state : private std::pmr::set<single_state> {
         public:
+            state(const state& s2) : std::pmr::set<single_state>(s2, compile_arena::current()), atm(s2.atm) {}
+            state(state&& s2) = default;
+            state& operator=(const state& s2) = default;
+            state& operator=(state&& s2) = default;
+
             state next_state(char next) const;
             state& next(char next);
             state& operator+=(const state& s2);
 
+            using std::pmr::set<single_state>::empty;
+            using std::pmr::set<single_state>::size;
+
             // Expose compare functions
 #define __EXT_CMP(cmp) \
             inline bool operator cmp (const state& s2) const {    \
                 if (atm == s2.atm) { \
-                    return  static_cast<const std::set<single_state>&>(*this)   \
-                            cmp static_cast<const std::set<single_state>&>(s2); \
+                    return  static_cast<const std::pmr::set<single_state>&>(*this)   \
+                            cmp static_cast<const std::pmr::set<single_state>&>(s2); \
                 } else { \
                     return atm cmp s2.atm;\
                 } \
@@ -44,13 +56,15 @@ namespace regexs {
 
             const nondeterministic_automaton* atm;
 
-            state(const nondeterministic_automaton* atm) : std::set<single_state>(), atm(atm) {}
-            state(const nondeterministic_automaton* atm, std::initializer_list<single_state> il) : std::set<single_state>(std::move(il)), atm(atm) {}
+            state(const nondeterministic_automaton* atm) : std::pmr::set<single_state>(compile_arena::current()), atm(atm) {}
+            state(const nondeterministic_automaton* atm, std::initializer_list<single_state> il) : std::pmr::set<single_state>(il, compile_arena::current()), atm(atm) {}
         };
 
         nondeterministic_automaton();
 
         inline size_t state_count() const { return nodes.size(); }
+        size_t edge_count() const;
+        size_t epsilon_edge_count() const;
 
         single_state add_state();
         void add_jump(single_state from, char ch, single_state to);
@@ -79,10 +93,21 @@ namespace regexs {
         void refactor_to_skippable();
         void connect(const nondeterministic_automaton& atm);
         void make_origin_branch(const nondeterministic_automaton& m2);
+        void refactor_to_unanchored();
+        nondeterministic_automaton reverse() const;
 
         std::string serialize() const;
 
         deterministic_automaton to_deterministic() const;
+        deterministic_automaton subset_construction(
+            size_t max_states = std::numeric_limits<size_t>::max(),
+            size_t max_bytes = std::numeric_limits<size_t>::max()
+        ) const;
+        deterministic_automaton parallel_subset_construction(
+            size_t threads,
+            size_t max_states = std::numeric_limits<size_t>::max(),
+            size_t max_bytes = std::numeric_limits<size_t>::max()
+        ) const;
     private:
         struct state_node {
             std::multimap<char, single_state> next;
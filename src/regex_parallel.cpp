@@ -0,0 +1,256 @@
+#include "regex_dfa.hpp"
+#include "regex_nfa.hpp"
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace regexs;
+
+// Runs fn on the given number of threads. The first exception any of them throws sets
+// stop, which fn should poll to give up early, and is rethrown once all have joined.
+static void run_workers(size_t threads, std::atomic<bool>& stop, const std::function<void(size_t)>& fn) {
+    std::exception_ptr error;
+    std::mutex error_lock;
+
+    std::vector<std::thread> workers;
+    for (size_t worker = 0; worker < threads; worker++) {
+        workers.emplace_back([&, worker] {
+            try {
+                fn(worker);
+            } catch (...) {
+                stop = true;
+                std::lock_guard<std::mutex> guard(error_lock);
+                if (!error) error = std::current_exception();
+            }
+        });
+    }
+    for (std::thread& t : workers) {
+        t.join();
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+// Expands the DFA one BFS level at a time. Workers take frontier subsets from a shared
+// cursor and intern the subsets they reach in hash-sharded tables, so IDs depend on
+// thread timing. The DFA is then renumbered by a BFS over the recorded edges in
+// character order, which gives exactly the numbering of subset_construction().
+deterministic_automaton nondeterministic_automaton::parallel_subset_construction(
+    size_t threads, size_t max_states, size_t max_bytes
+) const {
+    if (threads <= 1) {
+        return subset_construction(max_states, max_bytes);
+    }
+
+    constexpr size_t node_overhead = 4 * sizeof(void*);
+    constexpr size_t transition_bytes = sizeof(std::pair<char, deterministic_automaton::state>) + node_overhead;
+    constexpr size_t subset_entry_bytes = sizeof(single_state) + node_overhead;
+    constexpr size_t state_bytes = sizeof(std::map<char, deterministic_automaton::state>) + sizeof(std::set<int>)
+                                 + sizeof(std::pair<state, deterministic_automaton::state>) + node_overhead;
+
+    // Each worker builds subsets in its own arena. Shard maps allocate their nodes from
+    // an arena of their own, which is only touched under the shard lock.
+    std::vector<compile_arena> worker_arenas(threads);
+    compile_arena main_arena;
+    compile_arena::scope in_arena(main_arena);
+
+    struct shard {
+        std::mutex lock;
+        compile_arena arena;
+        std::pmr::map<state, size_t> ids{arena.resource()};
+    };
+    std::vector<shard> shards(threads * 8);
+    auto shard_of = [&](const state& st) -> shard& {
+        size_t h = st.size();
+        for (single_state ss : st) {
+            h = h * 1000003 ^ ss;
+        }
+        return shards[h % shards.size()];
+    };
+
+    state start = start_state();
+    const state* start_key = &shard_of(start).ids.emplace(start, 0).first->first;
+
+    std::atomic<size_t> next_id{1};
+    std::atomic<size_t> bytes{state_bytes + start.size() * subset_entry_bytes};
+    std::vector<const state*> subsets = {start_key};
+    std::vector<std::vector<std::pair<char, size_t>>> edges;
+    std::vector<std::pair<size_t, const state*>> frontier = {{0, start_key}};
+    std::atomic<bool> stop{false};
+
+    while (!frontier.empty()) {
+        edges.resize(next_id);
+        std::vector<std::vector<std::pair<size_t, const state*>>> discovered(threads);
+        std::atomic<size_t> cursor{0};
+
+        run_workers(threads, stop, [&](size_t worker) {
+            compile_arena::scope in_arena(worker_arenas[worker]);
+            for (size_t i = cursor++; i < frontier.size() && !stop; i = cursor++) {
+                auto [id, st] = frontier[i];
+                for (char ch : st->character_transitions()) {
+                    if (stop) {
+                        return;
+                    }
+                    state next_st = st->next_state(ch);
+                    shard& sh = shard_of(next_st);
+
+                    size_t next;
+                    {
+                        std::lock_guard<std::mutex> guard(sh.lock);
+                        auto it = sh.ids.find(next_st);
+                        if (it == sh.ids.end()) {
+                            next = next_id++;
+                            if (next >= max_states) {
+                                throw budget_exceeded("subset construction exceeded the DFA state budget");
+                            }
+                            bytes += state_bytes + next_st.size() * subset_entry_bytes;
+                            it = sh.ids.emplace(std::move(next_st), next).first;
+                            discovered[worker].emplace_back(next, &it->first);
+                        }
+                        next = it->second;
+                    }
+                    edges[id].emplace_back(ch, next);
+
+                    if ((bytes += transition_bytes) > max_bytes) {
+                        throw budget_exceeded("subset construction exceeded the DFA memory budget");
+                    }
+                }
+            }
+        });
+
+        frontier.clear();
+        subsets.resize(next_id);
+        for (auto& found : discovered) {
+            for (auto [id, st] : found) {
+                frontier.emplace_back(id, st);
+                subsets[id] = st;
+            }
+        }
+    }
+
+    deterministic_automaton atm;
+    std::vector<deterministic_automaton::state> renumber(subsets.size(), deterministic_automaton::REJECT);
+    std::deque<size_t> queue = {0};
+    renumber[0] = atm.start_state();
+    while (!queue.empty()) {
+        size_t id = queue.front();
+        queue.pop_front();
+        for (auto [ch, to] : edges[id]) {
+            if (renumber[to] == deterministic_automaton::REJECT) {
+                renumber[to] = atm.add_state();
+                queue.push_back(to);
+            }
+            atm.set_jump(renumber[id], ch, renumber[to]);
+        }
+    }
+
+    for (size_t id = 0; id < subsets.size(); id++) {
+        atm.set_stop_state(renumber[id], is_stop_state(*subsets[id]));
+        for (int mark : subsets[id]->state_marks()) {
+            atm.add_state_mark(renumber[id], mark);
+        }
+    }
+
+    return atm;
+}
+
+struct signature_hash {
+    size_t operator()(const std::vector<size_t>& sig) const {
+        size_t h = sig.size();
+        for (size_t v : sig) {
+            h = (h ^ v) * 0x100000001b3ULL;
+        }
+        return h;
+    }
+};
+
+// Moore-style refinement: every round each state gets the signature of its block and
+// the blocks of its targets per byte class, computed in parallel, and states are regrouped by
+// signature in state order. It stops once a round splits nothing. Unlike simplify()
+// this always reaches the minimal DFA, so it can end with fewer states.
+void deterministic_automaton::parallel_simplify(size_t threads) {
+    if (threads <= 1) {
+        simplify();
+        return;
+    }
+
+    constexpr size_t chunk = 256;
+    size_t n = state_count();
+
+    // Bytes of one class move every state alike, so one byte per class is enough
+    byte_class_map classes;
+    std::vector<char> class_bytes(byte_classes(classes));
+    for (int b = 255; b >= 0; b--) {
+        class_bytes[classes[b]] = static_cast<char>(b);
+    }
+
+    std::vector<size_t> block(n);
+    std::map<std::pair<bool, std::set<int>>, size_t> initial_blocks;
+    for (state s = 0; s < n; s++) {
+        std::pair<bool, std::set<int>> key{is_stop_state(s), is_stop_state(s) ? state_mark(s) : std::set<int>()};
+        block[s] = initial_blocks.emplace(std::move(key), initial_blocks.size()).first->second;
+    }
+    size_t block_count = initial_blocks.size();
+
+    std::vector<std::vector<size_t>> signatures(n);
+    std::atomic<bool> stop{false};
+    while (true) {
+        std::atomic<size_t> cursor{0};
+        run_workers(threads, stop, [&](size_t) {
+            for (size_t begin = cursor.fetch_add(chunk); begin < n && !stop; begin = cursor.fetch_add(chunk)) {
+                for (state s = begin; s < n && s < begin + chunk; s++) {
+                    std::vector<size_t>& sig = signatures[s];
+                    sig.clear();
+                    sig.push_back(block[s]);
+                    for (char ch : class_bytes) {
+                        state to = next_state(s, ch);
+                        sig.push_back(to == REJECT ? REJECT : block[to]);
+                    }
+                }
+            }
+        });
+
+        std::unordered_map<std::vector<size_t>, size_t, signature_hash> blocks(block_count * 2);
+        std::vector<size_t> next_block(n);
+        for (state s = 0; s < n; s++) {
+            next_block[s] = blocks.emplace(std::move(signatures[s]), blocks.size()).first->second;
+        }
+        if (blocks.size() == block_count) {
+            break;
+        }
+        block = std::move(next_block);
+        block_count = blocks.size();
+    }
+
+    std::vector<std::map<char, state>> new_state_map(block_count);
+    std::vector<std::set<int>> new_state_marks(block_count);
+    std::set<state> new_end_states;
+    std::vector<bool> filled(block_count, false);
+    for (state s = 0; s < n; s++) {
+        size_t b = block[s];
+        if (filled[b]) continue;
+        filled[b] = true;
+
+        new_state_map[b] = std::move(state_map[s]);
+        for (auto& [ch, to] : new_state_map[b]) {
+            to = (to == REJECT) ? REJECT : block[to];
+        }
+        new_state_marks[b] = state_marks[s];
+        if (is_stop_state(s)) {
+            new_end_states.insert(b);
+        }
+    }
+
+    state_map = std::move(new_state_map);
+    state_marks = std::move(new_state_marks);
+    __end_states = std::move(new_end_states);
+    __start_state = block[__start_state];
+}
@@ -8,6 +8,47 @@
     if (!(condition)) throw std::runtime_error("Assertion failed: "#condition)
 
 namespace regexs {
+    pattern_anchors strip_anchors(std::string_view& sv) {
+        pattern_anchors anchors;
+        anchors.begin = !sv.empty() && sv.front() == '^';
+        if (anchors.begin) {
+            sv.remove_prefix(1);
+        }
+        anchors.end = !sv.empty() && sv.back() == '$';
+        if (anchors.end) {
+            sv.remove_suffix(1);
+        }
+
+        int depth = 0;
+        bool alternation = false;
+        for (size_t i = 0; i < sv.size(); i++) {
+            switch (sv[i]) {
+            case '[':
+                while (i < sv.size() && sv[i] != ']') {
+                    if (sv[i] == '\\') i++;
+                    i++;
+                }
+                break;
+            case '(':
+                depth++;
+                break;
+            case ')':
+                depth--;
+                break;
+            case '|':
+                alternation = alternation || depth == 0;
+                break;
+            case '^':
+            case '$':
+                throw std::invalid_argument("'^' and '$' are only anchors at the ends of the pattern; use [\\^] or [$] for the characters");
+            }
+        }
+        if (alternation && (anchors.begin || anchors.end)) {
+            throw std::invalid_argument("anchors apply to the whole pattern; put the alternation in parentheses");
+        }
+        return anchors;
+    }
+
     std::vector<std::shared_ptr<token>> regex_tokenize(std::string_view sv) {
         std::vector<std::shared_ptr<token>> tokens;
 
@@ -73,17 +114,23 @@ namespace regexs {
         return tokens;
     }
 
-    nondeterministic_automaton build_nfa(const std::vector<std::shared_ptr<token>>& tokens) {
-        std::deque<nondeterministic_automaton> operands;
+    static inline char other_case(char c) {
+        if (c >= 'a' && c <= 'z') return c - 'a' + 'A';
+        if (c >= 'A' && c <= 'Z') return c - 'A' + 'a';
+        return c;
+    }
+
+    pattern_node::pointer parse_pattern(const std::vector<std::shared_ptr<token>>& tokens, bool case_insensitive) {
+        std::deque<pattern_node::pointer> operands;
         std::deque<std::shared_ptr<token>> opers;
 
         for (const std::shared_ptr<token>& tk : tokens) {
             switch (tk->get_type()) {
             case token::STRING:
-                operands.push_back(string_automaton(dynamic_cast<plain_string&>(*tk).content()));
+                operands.push_back(pattern_node::literal(dynamic_cast<plain_string&>(*tk).content()));
                 break;
             case token::CHAR_SELECTOR:
-                operands.push_back(selector_automaton(dynamic_cast<char_selector&>(*tk)));
+                operands.push_back(pattern_node::char_class(selector_chars(dynamic_cast<char_selector&>(*tk), case_insensitive)));
                 break;
             case token::OPERATOR:
                 {
@@ -125,18 +172,80 @@ namespace regexs {
             opers.pop_back();
         }
 
+        if (tokens.empty()) {
+            return pattern_node::empty();
+        }
+
         assert(operands.size() == 1);
 
         return operands.back();
     }
 
-    nondeterministic_automaton string_automaton(std::string_view s) {
+    nondeterministic_automaton pattern_automaton(const pattern_node& node, bool case_insensitive) {
+        switch (node.node_kind()) {
+        case pattern_node::LITERAL:
+            return string_automaton(node.text(), case_insensitive);
+        case pattern_node::CLASS:
+            {
+                nondeterministic_automaton atm;
+                auto stop_state = atm.add_state();
+                atm.set_stop_state(stop_state);
+                for (int ch = 0; ch < 256; ch++) {
+                    if (node.chars()[ch]) {
+                        atm.add_jump(atm.start_single_state(), static_cast<char>(ch), stop_state);
+                    }
+                }
+                return atm;
+            }
+        case pattern_node::CONCAT:
+        case pattern_node::ALTERNATE:
+            {
+                nondeterministic_automaton atm = pattern_automaton(*node.children()[0], case_insensitive);
+                for (size_t i = 1; i < node.children().size(); i++) {
+                    if (node.node_kind() == pattern_node::CONCAT) {
+                        atm.connect(pattern_automaton(*node.children()[i], case_insensitive));
+                    } else {
+                        atm.make_origin_branch(pattern_automaton(*node.children()[i], case_insensitive));
+                    }
+                }
+                return atm;
+            }
+        case pattern_node::STAR:
+        case pattern_node::PLUS:
+        case pattern_node::OPTIONAL:
+            {
+                nondeterministic_automaton atm = pattern_automaton(*node.children()[0], case_insensitive);
+                if (node.node_kind() != pattern_node::OPTIONAL) {
+                    atm.refactor_to_repetitive();
+                }
+                if (node.node_kind() != pattern_node::PLUS) {
+                    atm.refactor_to_skippable();
+                }
+                return atm;
+            }
+        case pattern_node::EMPTY:
+            break;
+        }
+        return string_automaton("");
+    }
+
+    // The pattern is simplified before its NFA is built, see simplify_pattern
+    nondeterministic_automaton build_nfa(const std::vector<std::shared_ptr<token>>& tokens, bool case_insensitive) {
+        pattern_node::pointer pattern = simplify_pattern(parse_pattern(tokens, case_insensitive), case_insensitive);
+        return pattern_automaton(*pattern, case_insensitive);
+    }
+
+    nondeterministic_automaton string_automaton(std::string_view s, bool case_insensitive) {
         nondeterministic_automaton atm;
 
         auto state = atm.start_single_state();
         for (char c : s) {
             auto next_state = atm.add_state();
             atm.add_jump(state, c, next_state);
+            // Both cases share the target state, so folding adds no states
+            if (case_insensitive && other_case(c) != c) {
+                atm.add_jump(state, other_case(c), next_state);
+            }
             state = next_state;
         }
         atm.set_stop_state(state);
@@ -144,9 +253,8 @@ namespace regexs {
         return atm;
     }
 
-    nondeterministic_automaton selector_automaton(const char_selector& selector) {
-        using single_state = nondeterministic_automaton::single_state;
-        
+    // Selectors only cover printable ASCII, negated ones included
+    pattern_node::char_set selector_chars(const char_selector& selector, bool case_insensitive) {
         std::string sel_content = selector.content();
 
         std::array<bool, 128> char_sel;
@@ -179,6 +287,11 @@ namespace regexs {
             }
             char_sel[sel_content[i]] = true;
         }
+        if (case_insensitive) {
+            for (char ch = 'a'; ch <= 'z'; ch++) {
+                char_sel[ch] = char_sel[ch - 'a' + 'A'] = char_sel[ch] || char_sel[ch - 'a' + 'A'];
+            }
+        }
         if (negative) {
             for (bool& val : char_sel) {
                 val = !val;
@@ -186,18 +299,14 @@ namespace regexs {
         }
 
 
-        nondeterministic_automaton atm;
-        single_state start_state, stop_state;
-
-        start_state = atm.start_single_state();
-        atm.set_stop_state(stop_state = atm.add_state());
-        
+        pattern_node::char_set chars;
         for (char ch=0x20; ch<0x7f; ch++) {
-            if (char_sel[ch]) {
-                atm.add_jump(start_state, ch, stop_state);
-            }
+            chars[static_cast<unsigned char>(ch)] = char_sel[ch];
         }
+        return chars;
+    }
 
-        return atm;
+    nondeterministic_automaton selector_automaton(const char_selector& selector, bool case_insensitive) {
+        return pattern_automaton(*pattern_node::char_class(selector_chars(selector, case_insensitive)));
     }
 }
\ No newline at end of file
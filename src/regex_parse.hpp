@@ -5,6 +5,7 @@
 #include <deque>
 #include <memory>
 
+#include "regex_ast.hpp"
 #include "regex_nfa.hpp"
 
 namespace regexs {
@@ -45,7 +46,7 @@ namespace regexs {
         virtual int priority() const = 0;
         virtual int operand_count() const = 0;
         virtual char content() const = 0;
-        virtual void apply_operator(std::deque<nondeterministic_automaton>& operands) = 0;
+        virtual void apply_operator(std::deque<pattern_node::pointer>& operands) = 0;
 
         virtual std::string serialize() const override {
             return std::string("OPERATOR\'") + content() + "\'";
@@ -71,7 +72,7 @@ namespace regexs {
 
         std::string serialize() const override { return (__content == '(') ? "LEFT_BRACKET" : "RIGHT_BRACKET"; }
 
-        void apply_operator(std::deque<nondeterministic_automaton>& operands) override {}
+        void apply_operator(std::deque<pattern_node::pointer>& operands) override {}
     private:
         char __content;
     };
@@ -82,8 +83,8 @@ namespace regexs {
         int operand_count() const override  { return 1; }
         char content() const override       { return '+'; }
 
-        void apply_operator(std::deque<nondeterministic_automaton>& operands) override {
-            operands.back().refactor_to_repetitive();
+        void apply_operator(std::deque<pattern_node::pointer>& operands) override {
+            operands.back() = pattern_node::repeat(pattern_node::PLUS, operands.back());
         }
     };
 
@@ -93,8 +94,8 @@ namespace regexs {
         int operand_count() const override  { return 1; }
         char content() const override       { return '?'; }
 
-        void apply_operator(std::deque<nondeterministic_automaton>& operands) override {
-            operands.back().refactor_to_skippable();
+        void apply_operator(std::deque<pattern_node::pointer>& operands) override {
+            operands.back() = pattern_node::repeat(pattern_node::OPTIONAL, operands.back());
         }
     };
 
@@ -104,9 +105,8 @@ namespace regexs {
         int operand_count() const override  { return 1; }
         char content() const override       { return '*'; }
 
-        void apply_operator(std::deque<nondeterministic_automaton>& operands) override {
-            operands.back().refactor_to_repetitive();
-            operands.back().refactor_to_skippable();
+        void apply_operator(std::deque<pattern_node::pointer>& operands) override {
+            operands.back() = pattern_node::repeat(pattern_node::STAR, operands.back());
         }
     };
 
@@ -118,11 +118,10 @@ namespace regexs {
 
         std::string serialize() const override { return "CONNECT"; }
 
-        void apply_operator(std::deque<nondeterministic_automaton>& operands) override {
-            nondeterministic_automaton& r2 = operands[operands.size()-1];
-            nondeterministic_automaton& r1 = operands[operands.size()-2];
-            r1.connect(r2);
+        void apply_operator(std::deque<pattern_node::pointer>& operands) override {
+            pattern_node::pointer r2 = operands.back();
             operands.pop_back();
+            operands.back() = pattern_node::concat({operands.back(), r2});
         }
     };
 
@@ -132,11 +131,10 @@ namespace regexs {
         int operand_count() const override  { return 2; }
         char content() const override       { return '|'; }
 
-        void apply_operator(std::deque<nondeterministic_automaton>& operands) override {
-            nondeterministic_automaton& r2 = operands[operands.size()-1];
-            nondeterministic_automaton& r1 = operands[operands.size()-2];
-            r1.make_origin_branch(r2);
+        void apply_operator(std::deque<pattern_node::pointer>& operands) override {
+            pattern_node::pointer r2 = operands.back();
             operands.pop_back();
+            operands.back() = pattern_node::alternate({operands.back(), r2});
         }
     };
 
@@ -188,10 +186,23 @@ namespace regexs {
         }
     }
 
+    struct pattern_anchors {
+        bool begin = false;
+        bool end = false;
+    };
+
+    // Removes a leading '^' and a trailing '$' from sv; they anchor the whole pattern.
+    // Throws std::invalid_argument for a '^' or '$' anywhere else outside a selector,
+    // where [\^] and [$] stand for the characters, and for anchors on a pattern with a
+    // top-level '|', which other dialects would anchor branch by branch.
+    pattern_anchors strip_anchors(std::string_view& sv);
     std::vector<std::shared_ptr<token>> regex_tokenize(std::string_view sv);
-    nondeterministic_automaton build_nfa(const std::vector<std::shared_ptr<token>>& tokens);
-    nondeterministic_automaton string_automaton(std::string_view s);
-    nondeterministic_automaton selector_automaton(const char_selector& selector);
+    pattern_node::pointer parse_pattern(const std::vector<std::shared_ptr<token>>& tokens, bool case_insensitive = false);
+    nondeterministic_automaton pattern_automaton(const pattern_node& node, bool case_insensitive = false);
+    nondeterministic_automaton build_nfa(const std::vector<std::shared_ptr<token>>& tokens, bool case_insensitive = false);
+    nondeterministic_automaton string_automaton(std::string_view s, bool case_insensitive = false);
+    pattern_node::char_set selector_chars(const char_selector& selector, bool case_insensitive = false);
+    nondeterministic_automaton selector_automaton(const char_selector& selector, bool case_insensitive = false);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,108 @@
+#include "regex_profile.hpp"
+#include "regex_table.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <iomanip>
+#include <map>
+#include <numeric>
+#include <sstream>
+
+using namespace regexs;
+
+void table_profile::resize(size_t states, size_t classes) {
+    __visits.assign(states, 0);
+    __ends.assign(states, 0);
+    __class_hits.assign(classes, 0);
+    __skipped = __unread = 0;
+}
+
+void table_profile::reset() {
+    resize(__visits.size(), __class_hits.size());
+}
+
+uint64_t table_profile::bytes() const {
+    return std::accumulate(__visits.begin(), __visits.end(), uint64_t(0));
+}
+
+uint64_t table_profile::runs() const {
+    return std::accumulate(__ends.begin(), __ends.end(), uint64_t(0));
+}
+
+static std::string percent(uint64_t part, uint64_t whole) {
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(1) << (whole ? 100.0 * part / whole : 0.0) << '%';
+    return ss.str();
+}
+
+// Lists the bytes of a class as ranges, e.g. [0-9a-f]
+static std::string describe_class(const transition_table& table, size_t cls) {
+    auto show = [](int b) {
+        if (b > 0x20 && b < 0x7f && b != ']' && b != '-' && b != '\\') return std::string(1, static_cast<char>(b));
+        char buf[8];
+        std::snprintf(buf, sizeof(buf), "\\x%02x", b);
+        return std::string(buf);
+    };
+
+    std::string out = "[";
+    for (int b = 0; b < 256; b++) {
+        if (table.byte_classes()[b] != cls) continue;
+        int e = b;
+        while (e + 1 < 256 && table.byte_classes()[e + 1] == cls) e++;
+        out += show(b);
+        if (e > b) out += "-" + show(e);
+        if (out.size() > 32) {
+            return out + "...]";
+        }
+        b = e;
+    }
+    return out + "]";
+}
+
+std::string table_profile::serialize(const transition_table& table, size_t top) const {
+    uint64_t total = bytes();
+    uint64_t run_count = runs();
+
+    std::stringstream seri_stream;
+    seri_stream << "BYTES = " << total << '\n'
+                << "RUNS = " << run_count << '\n'
+                << "DEAD_RUNS = " << __ends[table.dead_state()] << " (" << percent(__ends[table.dead_state()], run_count) << ")\n"
+                << "UNREAD_BYTES = " << __unread << '\n'
+                << "SKIPPED_BYTES = " << __skipped << " (" << percent(__skipped, total) << ")\n";
+
+    std::vector<state> states(__visits.size());
+    std::iota(states.begin(), states.end(), 0);
+    std::sort(states.begin(), states.end(), [&](state a, state b) { return __visits[a] > __visits[b]; });
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < states.size() && i < top && __visits[states[i]] != 0; i++) {
+        state s = states[i];
+        cumulative += __visits[s];
+        seri_stream << "STATE" << s << ' ' << transition_table::kind_name(table.kind(s)) << ": "
+                    << __visits[s] << " bytes (" << percent(__visits[s], total) << ", cumulative " << percent(cumulative, total) << ")";
+        if (__ends[s] != 0) {
+            seri_stream << ", " << __ends[s] << " runs ended";
+        }
+        seri_stream << '\n';
+    }
+
+    std::vector<size_t> classes(__class_hits.size());
+    std::iota(classes.begin(), classes.end(), 0);
+    std::sort(classes.begin(), classes.end(), [&](size_t a, size_t b) { return __class_hits[a] > __class_hits[b]; });
+    uint64_t steps = total - __skipped;
+    for (size_t i = 0; i < classes.size() && i < top && __class_hits[classes[i]] != 0; i++) {
+        size_t k = classes[i];
+        seri_stream << "CLASS" << k << ' ' << describe_class(table, k) << ": "
+                    << __class_hits[k] << " steps (" << percent(__class_hits[k], steps) << ")\n";
+    }
+
+    std::map<int, uint64_t> mark_ends;
+    for (state s = 0; s < __ends.size(); s++) {
+        if (__ends[s] == 0 || !table.is_stop_state(s)) continue;
+        for (int mark : table.state_mark(s)) {
+            mark_ends[mark] += __ends[s];
+        }
+    }
+    for (auto& [mark, count] : mark_ends) {
+        seri_stream << "MARK" << mark << ": " << count << " runs (" << percent(count, run_count) << ")\n";
+    }
+    return seri_stream.str();
+}
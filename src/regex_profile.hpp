@@ -0,0 +1,69 @@
+#ifndef REGEX_PROFILE_HPP
+#define REGEX_PROFILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Building with -DREGEX_PROFILE makes the matching loops of transition_table count
+// where they spend their bytes. Without it the hooks expand to nothing.
+#ifdef REGEX_PROFILE
+#define REGEX_PROFILED(stmt) stmt
+#define REGEX_PROFILE_ENABLED true
+#else
+#define REGEX_PROFILED(stmt)
+#define REGEX_PROFILE_ENABLED false
+#endif
+
+namespace regexs {
+    class transition_table;
+
+    // Counters collected by one transition_table. Every byte is charged to the state
+    // it was read in, whether it took a table step or was passed over by a skip loop.
+    // A run is one input given to run or run_batch; scan_lines shows up as visits of the
+    // two line end states instead. The counters are not atomic, so profile with one
+    // thread per table.
+    class table_profile {
+    public:
+        using state = uint32_t;
+
+        static constexpr bool ENABLED = REGEX_PROFILE_ENABLED;
+
+        void resize(size_t states, size_t classes);
+        void reset();
+
+        inline void step(state s, size_t cls) {
+            __visits[s]++;
+            __class_hits[cls]++;
+        }
+        inline void skip(state s, size_t bytes) {
+            __visits[s] += bytes;
+            __skipped += bytes;
+        }
+        inline void end_run(state s, size_t unread) {
+            __ends[s]++;
+            __unread += unread;
+        }
+
+        uint64_t bytes() const;
+        uint64_t runs() const;
+        inline uint64_t skipped_bytes() const { return __skipped; }
+        inline uint64_t unread_bytes() const { return __unread; }
+        inline const std::vector<uint64_t>& visits() const { return __visits; }
+        inline const std::vector<uint64_t>& ends() const { return __ends; }
+        inline const std::vector<uint64_t>& class_hits() const { return __class_hits; }
+
+        // Totals, then the top busiest states and byte classes, then the runs ending
+        // on each mark
+        std::string serialize(const transition_table& table, size_t top = 10) const;
+    private:
+        std::vector<uint64_t> __visits;
+        std::vector<uint64_t> __ends;
+        std::vector<uint64_t> __class_hits;
+        uint64_t __skipped = 0;
+        uint64_t __unread = 0;
+    };
+}
+
+#endif
@@ -0,0 +1,401 @@
+#include "regex_set.hpp"
+#include "regex_ast.hpp"
+#include "regex_nfa.hpp"
+#include "regex_parse.hpp"
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+
+namespace regexs {
+    regex_set::regex_set(const compile_options& options) :
+        __options(options),
+        __capacity(0),
+        __tree(2)
+    {}
+
+    // Every pattern is matched against the whole input, and streams cannot anchor the
+    // patterns of one table separately, so sets take no anchors
+    void regex_set::add(int mark, std::string_view pattern) {
+        pattern_anchors anchors = strip_anchors(pattern);
+        if (anchors.begin || anchors.end) {
+            throw std::invalid_argument("pattern sets do not support anchors");
+        }
+        pattern_node::pointer node = simplify_pattern(parse_pattern(regex_tokenize(pattern), __options.case_insensitive), __options.case_insensitive);
+        nondeterministic_automaton nfa = pattern_automaton(*node, __options.case_insensitive);
+        nfa.add_end_state_mark(mark);
+        auto dfa = std::make_shared<const deterministic_automaton>(compile_dfa(nfa, __options));
+
+        auto it = __slots.find(mark);
+        size_t slot = (it != __slots.end()) ? it->second : allocate_slot();
+        __slots[mark] = slot;
+        if (auto words = finite_language(node, __options.max_literals)) {
+            __literal_words[mark] = std::move(*words);
+        } else {
+            __literal_words.erase(mark);
+        }
+        __literal_index.reset();
+        __pattern_facts[mark] = analyze_pattern(*node, __options.case_insensitive);
+        merge_facts();
+        set_leaf(slot, std::move(dfa), std::move(node));
+    }
+
+    bool regex_set::remove(int mark) {
+        auto it = __slots.find(mark);
+        if (it == __slots.end()) {
+            return false;
+        }
+
+        set_leaf(it->second, nullptr, nullptr);
+        __free_slots.push_back(it->second);
+        __slots.erase(it);
+        __literal_words.erase(mark);
+        __literal_index.reset();
+        __pattern_facts.erase(mark);
+        merge_facts();
+        return true;
+    }
+
+    bool regex_set::contains(int mark) const {
+        return __slots.count(mark) > 0;
+    }
+
+    size_t regex_set::size() const {
+        return __slots.size();
+    }
+
+    std::set<int> regex_set::match(std::string_view sv) const {
+        if (!__facts.admits(sv)) {
+            return {};
+        }
+        if (auto index = literal_index()) {
+            auto it = index->find(fold(sv));
+            return (it != index->end()) ? it->second : std::set<int>();
+        }
+
+        const auto& all = shards();
+        if (all.size() == 1) {
+            const transition_table& tbl = all[0]->table;
+            transition_table::state s = all[0]->run(tbl.start_state(), sv);
+            if (!tbl.is_stop_state(s)) {
+                return {};
+            }
+            return tbl.state_mark(s);
+        }
+
+        // Shards drop out once they die or accept forever
+        std::vector<transition_table::state> states(all.size());
+        std::vector<size_t> live(all.size());
+        for (size_t k = 0; k < all.size(); k++) {
+            states[k] = all[k]->table.start_state();
+            live[k] = k;
+        }
+        for (size_t pos = 0; pos < sv.size() && !live.empty(); pos += SHARD_BLOCK_BYTES) {
+            std::string_view block = sv.substr(pos, SHARD_BLOCK_BYTES);
+            size_t kept = 0;
+            for (size_t k : live) {
+                states[k] = all[k]->run(states[k], block);
+                transition_table::state_kind kind = all[k]->table.kind(states[k]);
+                if (kind != transition_table::DEAD && kind != transition_table::ACCEPT_FOREVER) {
+                    live[kept++] = k;
+                }
+            }
+            live.resize(kept);
+        }
+
+        std::set<int> marks;
+        for (size_t k = 0; k < all.size(); k++) {
+            const transition_table& tbl = all[k]->table;
+            if (tbl.is_stop_state(states[k])) {
+                marks.insert(tbl.state_mark(states[k]).begin(), tbl.state_mark(states[k]).end());
+            }
+        }
+        return marks;
+    }
+
+    std::vector<std::set<int>> regex_set::match_batch(const std::vector<std::string_view>& inputs) const {
+        std::vector<std::set<int>> marks(inputs.size());
+        if (literal_index() != nullptr) {
+            for (size_t i = 0; i < inputs.size(); i++) {
+                marks[i] = match(inputs[i]);
+            }
+            return marks;
+        }
+
+        std::vector<std::string_view> admitted;
+        std::vector<size_t> positions;
+        for (size_t i = 0; i < inputs.size(); i++) {
+            if (__facts.admits(inputs[i])) {
+                admitted.push_back(inputs[i]);
+                positions.push_back(i);
+            }
+        }
+
+        std::vector<transition_table::state> results(admitted.size());
+        for (auto& sh : shards()) {
+            const transition_table& tbl = sh->table;
+            if (sh->shuffle_ptr != nullptr) {
+                for (size_t i = 0; i < admitted.size(); i++) {
+                    results[i] = sh->shuffle_ptr->run(tbl.start_state(), admitted[i]);
+                }
+            } else {
+                tbl.run_batch(admitted.data(), admitted.size(), results.data());
+            }
+
+            for (size_t i = 0; i < admitted.size(); i++) {
+                if (tbl.is_stop_state(results[i])) {
+                    marks[positions[i]].insert(tbl.state_mark(results[i]).begin(), tbl.state_mark(results[i]).end());
+                }
+            }
+        }
+        return marks;
+    }
+
+    const pattern_facts& regex_set::facts() const {
+        return __facts;
+    }
+
+    size_t regex_set::shard_count() const {
+        return shards().size();
+    }
+
+    const transition_table& regex_set::shard_table(size_t index) const {
+        return shards().at(index)->table;
+    }
+
+    const transition_table& regex_set::table() const {
+        const auto& all = shards();
+        if (all.size() != 1) {
+            throw budget_exceeded("pattern set is split into several shards");
+        }
+        return all[0]->table;
+    }
+
+    size_t regex_set::stream_shard_count() const {
+        return stream_shards().size();
+    }
+
+    const transition_table& regex_set::stream_shard_table(size_t index) const {
+        return *stream_shards().at(index);
+    }
+
+    const transition_table& regex_set::stream_table() const {
+        const auto& all = stream_shards();
+        if (all.size() != 1) {
+            throw budget_exceeded("pattern set streams are split into several shards");
+        }
+        return *all[0];
+    }
+
+    stream_matcher regex_set::stream(stream_matcher::match_callback on_match) const {
+        std::vector<const transition_table*> tables;
+        for (auto& tbl : stream_shards()) {
+            tables.push_back(tbl.get());
+        }
+        return stream_matcher(std::move(tables), std::move(on_match));
+    }
+    const deterministic_automaton& regex_set::deter_automaton() const {
+        rebuild();
+        auto& root = __tree[1].shards;
+        if (root.empty()) {
+            return __empty;
+        }
+        if (root.size() != 1) {
+            throw budget_exceeded("pattern set is split into several shards");
+        }
+        return *root[0];
+    }
+
+    regex_set::shard::shard(const deterministic_automaton& dfa, bool plain) : table(dfa) {
+        if (plain) {
+            return;
+        }
+        if (shuffle_table::fits(table)) {
+            shuffle_ptr = std::make_unique<shuffle_table>(table);
+        } else if (compact_table::worth_compacting(table)) {
+            compact_ptr = std::make_unique<compact_table>(table);
+        }
+    }
+
+    transition_table::state regex_set::shard::run(transition_table::state s, std::string_view sv) const {
+        if (shuffle_ptr != nullptr) {
+            return shuffle_ptr->run(s, sv);
+        }
+        if (compact_ptr != nullptr) {
+            return compact_ptr->run(s, sv);
+        }
+        return table.run(s, sv);
+    }
+
+    const std::vector<std::unique_ptr<regex_set::shard>>& regex_set::shards() const {
+        if (__shards.empty()) {
+            rebuild();
+            for (auto& dfa : __tree[1].shards) {
+                __shards.push_back(std::make_unique<shard>(*dfa, __options.profile));
+            }
+            if (__shards.empty()) {
+                __shards.push_back(std::make_unique<shard>(__empty, __options.profile));
+            }
+        }
+        return __shards;
+    }
+
+    // Streams need every pattern unanchored at the front, which the merge tree cannot
+    // provide. Each leaf compiles its pattern unanchored the first time a stream needs it
+    // and keeps the DFA, so rebuilding the tables only places the leaf DFAs into shards
+    // again. Adding or removing a pattern invalidates the tables, and with them every
+    // matcher made by stream().
+    const std::vector<std::unique_ptr<transition_table>>& regex_set::stream_shards() const {
+        if (__stream_tables.empty()) {
+            std::vector<dfa_pointer> dfas;
+            for (auto [mark, slot] : __slots) {
+                merge_node& leaf = __tree[__capacity + slot];
+                if (leaf.stream_dfa == nullptr) {
+                    nondeterministic_automaton nfa = pattern_automaton(*leaf.pattern, __options.case_insensitive);
+                    nfa.add_end_state_mark(mark);
+                    nfa.refactor_to_unanchored();
+                    leaf.stream_dfa = std::make_shared<const deterministic_automaton>(compile_dfa(nfa, __options));
+                }
+                place_shard(dfas, leaf.stream_dfa);
+            }
+            for (auto& dfa : dfas) {
+                __stream_tables.push_back(std::make_unique<transition_table>(*dfa));
+            }
+            if (__stream_tables.empty()) {
+                __stream_tables.push_back(std::make_unique<transition_table>(__empty));
+            }
+        }
+        return __stream_tables;
+    }
+
+    // Built on first use, and only while every pattern has a finite language
+    const std::unordered_map<std::string, std::set<int>>* regex_set::literal_index() const {
+        if (__options.profile || __literal_words.empty() || __literal_words.size() != __slots.size()) {
+            return nullptr;
+        }
+        if (__literal_index == nullptr) {
+            __literal_index = std::make_unique<std::unordered_map<std::string, std::set<int>>>();
+            for (auto& [mark, words] : __literal_words) {
+                for (auto& word : words) {
+                    (*__literal_index)[fold(word)].insert(mark);
+                }
+            }
+        }
+        return __literal_index.get();
+    }
+
+    std::string regex_set::fold(std::string_view sv) const {
+        std::string folded(sv);
+        if (__options.case_insensitive) {
+            for (char& c : folded) {
+                if (c >= 'A' && c <= 'Z') c = c - 'A' + 'a';
+            }
+        }
+        return folded;
+    }
+
+    void regex_set::merge_facts() {
+        __facts = pattern_facts();
+        for (auto& [mark, facts] : __pattern_facts) {
+            __facts.merge(facts);
+        }
+    }
+
+    size_t regex_set::allocate_slot() {
+        if (!__free_slots.empty()) {
+            size_t slot = __free_slots.back();
+            __free_slots.pop_back();
+            return slot;
+        }
+
+        size_t slot = __slots.size();
+        if (slot >= __capacity) {
+            grow();
+        }
+        return slot;
+    }
+
+    // Doubles the leaf count. The old tree becomes the left subtree of the new root,
+    // so none of its merges have to be redone.
+    void regex_set::grow() {
+        size_t new_capacity = (__capacity == 0) ? 1 : __capacity * 2;
+        std::vector<merge_node> new_tree(new_capacity * 2);
+
+        for (size_t i = 1, level = 1; i < __capacity * 2; i++) {
+            if (i == level * 2) level *= 2;
+            new_tree[i + level] = std::move(__tree[i]);
+        }
+        new_tree[1].dirty = true;
+
+        __tree = std::move(new_tree);
+        __capacity = new_capacity;
+    }
+
+    void regex_set::set_leaf(size_t slot, dfa_pointer dfa, pattern_node::pointer pattern) {
+        size_t node = __capacity + slot;
+        __tree[node].shards.clear();
+        if (dfa != nullptr) {
+            __tree[node].shards.push_back(std::move(dfa));
+        }
+        __tree[node].pattern = std::move(pattern);
+        __tree[node].stream_dfa = nullptr;
+        __shards.clear();
+        __stream_tables.clear();
+        for (node /= 2; node >= 1; node /= 2) {
+            __tree[node].dirty = true;
+        }
+    }
+
+    size_t regex_set::shard_limit() const {
+        return std::min(__options.max_shard_states, __options.max_dfa_states);
+    }
+
+    // Merges dfa into the first shard whose product with it stays within the limit, or
+    // makes it a shard of its own. The smallest shards are tried first; a product has
+    // at least as many states as either side, so shards already at the limit are not
+    // tried at all, and a failed product stops as soon as it passes the limit.
+    void regex_set::place_shard(std::vector<dfa_pointer>& shards, const dfa_pointer& dfa) const {
+        size_t limit = shard_limit();
+        std::vector<size_t> order(shards.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return shards[a]->state_count() < shards[b]->state_count();
+        });
+
+        for (size_t i : order) {
+            if (std::max(shards[i]->state_count(), dfa->state_count()) >= limit) {
+                break;
+            }
+            try {
+                deterministic_automaton merged = shards[i]->unite(*dfa, limit);
+                merged.parallel_simplify(__options.threads);
+                shards[i] = std::make_shared<const deterministic_automaton>(std::move(merged));
+                return;
+            } catch (const budget_exceeded&) {
+            }
+        }
+        shards.push_back(dfa);
+    }
+
+    void regex_set::rebuild() const {
+        if (__capacity > 0) {
+            rebuild(1);
+        }
+    }
+
+    void regex_set::rebuild(size_t node) const {
+        if (node >= __capacity || !__tree[node].dirty) {
+            return;
+        }
+
+        rebuild(node * 2);
+        rebuild(node * 2 + 1);
+
+        std::vector<dfa_pointer> shards = __tree[node * 2].shards;
+        for (auto& dfa : __tree[node * 2 + 1].shards) {
+            place_shard(shards, dfa);
+        }
+        __tree[node].shards = std::move(shards);
+        __tree[node].dirty = false;
+    }
+}
@@ -0,0 +1,111 @@
+#ifndef REGEX_SET_HPP
+#define REGEX_SET_HPP
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "regex_ast.hpp"
+#include "regex_compact.hpp"
+#include "regex_compile.hpp"
+#include "regex_dfa.hpp"
+#include "regex_shuffle.hpp"
+#include "regex_stream.hpp"
+#include "regex_table.hpp"
+
+namespace regexs {
+    // A set of patterns told apart by marks. Every pattern keeps its own minimized DFA,
+    // and the DFAs are merged pairwise by product construction in a balanced tree, so
+    // adding or removing a pattern only redoes the merges on its path to the root.
+    // A merge whose product would pass max_shard_states is not done; both sides are
+    // kept as separate shards instead, and match runs every shard over the input in one
+    // pass, a block at a time, and unites their marks. Streams keep shards of their own,
+    // placed under the same bound from an unanchored DFA per pattern that is compiled
+    // once, from the same simplified pattern as the leaf.
+    // While every pattern matches only a few fixed strings, match looks the input up in
+    // a hash index of those strings and the merged DFA is not built.
+    // Inputs that no pattern's facts admit are turned away before either.
+    class regex_set {
+    public:
+        // Bytes each shard reads before the next one takes over, small enough that the
+        // block stays in L1 between shards
+        static constexpr size_t SHARD_BLOCK_BYTES = 4096;
+
+        explicit regex_set(const compile_options& options = {});
+
+        void add(int mark, std::string_view pattern);
+        bool remove(int mark);
+        bool contains(int mark) const;
+        size_t size() const;
+
+        std::set<int> match(std::string_view sv) const;
+        std::vector<std::set<int>> match_batch(const std::vector<std::string_view>& inputs) const;
+        size_t shard_count() const;
+        const transition_table& shard_table(size_t index) const;
+        // The facts of all patterns merged
+        const pattern_facts& facts() const;
+        // Streams are sharded on their own, under the same state bound
+        size_t stream_shard_count() const;
+        const transition_table& stream_shard_table(size_t index) const;
+        // Only exist while the set fits in one shard; throw budget_exceeded otherwise
+        const deterministic_automaton& deter_automaton() const;
+        const transition_table& table() const;
+        const transition_table& stream_table() const;
+        stream_matcher stream(stream_matcher::match_callback on_match) const;
+    private:
+        using dfa_pointer = std::shared_ptr<const deterministic_automaton>;
+
+        struct merge_node {
+            std::vector<dfa_pointer> shards;
+            bool dirty = false;
+            // Leaves only: the simplified pattern, and its unanchored DFA once a stream
+            // has needed it
+            pattern_node::pointer pattern;
+            dfa_pointer stream_dfa;
+        };
+
+        // The table of one shard and its faster encodings, which keep its state numbering
+        struct shard {
+            transition_table table;
+            std::unique_ptr<shuffle_table> shuffle_ptr;
+            std::unique_ptr<compact_table> compact_ptr;
+
+            // plain keeps to the table, for profiling
+            shard(const deterministic_automaton& dfa, bool plain);
+            transition_table::state run(transition_table::state s, std::string_view sv) const;
+        };
+
+        compile_options __options;
+        std::map<int, size_t> __slots;
+        std::map<int, std::vector<std::string>> __literal_words;
+        std::map<int, pattern_facts> __pattern_facts;
+        pattern_facts __facts;
+        std::vector<size_t> __free_slots;
+        size_t __capacity;
+        // Heap layout: node i has children 2i and 2i+1, leaves live at [capacity, 2 * capacity)
+        mutable std::vector<merge_node> __tree;
+        deterministic_automaton __empty;
+        mutable std::vector<std::unique_ptr<shard>> __shards;
+        mutable std::vector<std::unique_ptr<transition_table>> __stream_tables;
+        mutable std::unique_ptr<std::unordered_map<std::string, std::set<int>>> __literal_index;
+
+        const std::unordered_map<std::string, std::set<int>>* literal_index() const;
+        std::string fold(std::string_view sv) const;
+        void merge_facts();
+        size_t allocate_slot();
+        void grow();
+        void set_leaf(size_t slot, dfa_pointer dfa, pattern_node::pointer pattern);
+        const std::vector<std::unique_ptr<shard>>& shards() const;
+        const std::vector<std::unique_ptr<transition_table>>& stream_shards() const;
+        size_t shard_limit() const;
+        void place_shard(std::vector<dfa_pointer>& shards, const dfa_pointer& dfa) const;
+        void rebuild() const;
+        void rebuild(size_t node) const;
+    };
+}
+
+#endif
@@ -0,0 +1,115 @@
+#include "regex_shuffle.hpp"
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define REGEX_SHUFFLE_X86
+#endif
+
+using namespace regexs;
+using state = shuffle_table::state;
+
+#ifdef REGEX_SHUFFLE_X86
+__attribute__((target("ssse3")))
+static state run_ssse3(const uint8_t* masks, uint64_t exits, state s, const unsigned char* p, const unsigned char* end) {
+    __m128i st = _mm_set1_epi8(static_cast<char>(s));
+    while (end - p >= static_cast<ptrdiff_t>(shuffle_table::EXIT_CHECK_BYTES)) {
+        for (size_t i = 0; i < shuffle_table::EXIT_CHECK_BYTES; i++) {
+            st = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(masks + p[i] * 16)), st);
+        }
+        p += shuffle_table::EXIT_CHECK_BYTES;
+        s = _mm_cvtsi128_si32(st) & 0xff;
+        if ((exits >> s) & 1) return s;
+    }
+    for (; p != end; p++) {
+        st = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(masks + *p * 16)), st);
+    }
+    return _mm_cvtsi128_si32(st) & 0xff;
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+static state run_vbmi(const uint8_t* masks, uint64_t exits, state s, const unsigned char* p, const unsigned char* end) {
+    // The zero-masked forms keep GCC from warning about the undefined vectors the plain
+    // ones start from
+    const __mmask64 all = ~__mmask64(0);
+    __m512i st = _mm512_maskz_set1_epi8(all, static_cast<char>(s));
+    while (end - p >= static_cast<ptrdiff_t>(shuffle_table::EXIT_CHECK_BYTES)) {
+        for (size_t i = 0; i < shuffle_table::EXIT_CHECK_BYTES; i++) {
+            st = _mm512_maskz_permutexvar_epi8(all, st, _mm512_loadu_si512(masks + p[i] * 64));
+        }
+        p += shuffle_table::EXIT_CHECK_BYTES;
+        s = _mm512_cvtsi512_si32(st) & 0xff;
+        if ((exits >> s) & 1) return s;
+    }
+    for (; p != end; p++) {
+        st = _mm512_maskz_permutexvar_epi8(all, st, _mm512_loadu_si512(masks + *p * 64));
+    }
+    return _mm512_cvtsi512_si32(st) & 0xff;
+}
+#endif
+
+size_t shuffle_table::max_states() {
+#ifdef REGEX_SHUFFLE_X86
+    static const size_t limit = [] {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512vbmi")) return static_cast<size_t>(VBMI);
+        if (__builtin_cpu_supports("ssse3")) return static_cast<size_t>(SSSE3);
+        return static_cast<size_t>(0);
+    }();
+    return limit;
+#else
+    return 0;
+#endif
+}
+
+bool shuffle_table::fits(const transition_table& table) {
+    return table.state_count() <= max_states();
+}
+
+// PSHUFB has the shorter latency, so it is used whenever the states fit in 16 lanes
+shuffle_table::shuffle_table(const transition_table& table) : __exits(0) {
+    if (!fits(table)) {
+        throw std::logic_error("transition table has too many states for shuffle execution");
+    }
+
+    size_t n = table.state_count();
+#ifdef REGEX_SHUFFLE_X86
+    __width = (n <= SSSE3 && __builtin_cpu_supports("ssse3")) ? SSSE3 : VBMI;
+#else
+    __width = SSSE3;
+#endif
+
+    // Lanes past the last state are never selected; they point at the dead state
+    __masks.assign(256 * __width, static_cast<uint8_t>(table.dead_state()));
+    for (int b = 0; b < 256; b++) {
+        for (state s = 0; s < n; s++) {
+            __masks[b * __width + s] = static_cast<uint8_t>(table.next_state(s, static_cast<char>(b)));
+        }
+    }
+    for (state s = 0; s < n; s++) {
+        transition_table::state_kind k = table.kind(s);
+        if (k == transition_table::DEAD || k == transition_table::ACCEPT_FOREVER) {
+            __exits |= uint64_t(1) << s;
+        }
+    }
+}
+
+state shuffle_table::run(state s, std::string_view sv) const {
+    if ((__exits >> s) & 1) {
+        return s;
+    }
+
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(sv.data());
+    const unsigned char* end = p + sv.size();
+#ifdef REGEX_SHUFFLE_X86
+    if (__width == SSSE3) {
+        return run_ssse3(__masks.data(), __exits, s, p, end);
+    }
+    return run_vbmi(__masks.data(), __exits, s, p, end);
+#else
+    for (; p != end; p++) {
+        s = __masks[*p * __width + s];
+    }
+    return s;
+#endif
+}
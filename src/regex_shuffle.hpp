@@ -0,0 +1,50 @@
+#ifndef REGEX_SHUFFLE_HPP
+#define REGEX_SHUFFLE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "regex_table.hpp"
+
+namespace regexs {
+    // Runs a small transition_table with byte shuffles instead of table loads (Sheng).
+    // Every byte value owns a vector holding the next state of each state, so one step
+    // is a shuffle of that vector by the current state, and the loop carries no load
+    // that depends on the state. Up to 16 states use SSSE3 PSHUFB, up to 64 use
+    // AVX-512 VBMI VPERMB; both are picked at run time from what the CPU supports.
+    //
+    // States keep the numbering of the source table, which answers is_stop_state and
+    // state_mark. On CPUs with neither extension nothing fits, and callers stay on the
+    // table.
+    class shuffle_table {
+    public:
+        using state = transition_table::state;
+
+        enum width {
+            SSSE3 = 16, VBMI = 64
+        };
+
+        // Exits are checked once per block, since each check stalls the shuffle chain
+        static constexpr size_t EXIT_CHECK_BYTES = 16;
+
+        static size_t max_states();
+        static bool fits(const transition_table& table);
+
+        explicit shuffle_table(const transition_table& table);
+
+        inline width lane_width() const { return __width; }
+        inline size_t memory_usage() const { return __masks.size(); }
+
+        // Same result as transition_table::run, which may leave before the end once the
+        // state is dead or accepts forever
+        state run(state s, std::string_view sv) const;
+    private:
+        width __width;
+        std::vector<uint8_t> __masks;   // 256 vectors of __width next states
+        uint64_t __exits;               // bit s: state s ends the run early
+    };
+}
+
+#endif
@@ -0,0 +1,113 @@
+#include "regex_stream.hpp"
+#include <utility>
+
+namespace regexs {
+    stream_matcher::stream_matcher(const transition_table& table, match_callback on_match, bool end_anchored) :
+        stream_matcher(std::vector<const transition_table*>{&table}, std::move(on_match), end_anchored)
+    {}
+
+    stream_matcher::stream_matcher(std::vector<const transition_table*> tables, match_callback on_match, bool end_anchored) :
+        __tables(std::move(tables)),
+        __on_match(std::move(on_match)),
+        __end_anchored(end_anchored),
+        __states(__tables.size())
+    {
+        reset();
+    }
+
+    void stream_matcher::feed(std::string_view chunk) {
+        start();
+        for (size_t k = 0; k < __tables.size(); k++) {
+            feed(k, chunk);
+        }
+        flush();
+        __offset += chunk.size();
+    }
+
+    void stream_matcher::feed(size_t k, std::string_view chunk) {
+        const transition_table& table = *__tables[k];
+        transition_table::state& state = __states[k];
+
+        const char* begin = chunk.data();
+        const char* end = begin + chunk.size();
+        if (__end_anchored) {
+            state = table.run(state, chunk);
+        } else {
+            const char* p = begin;
+            while (p != end && table.kind(state) != transition_table::DEAD) {
+                state = table.next_state(state, *p++);
+                state = table.run_to_stop(state, p, end);
+                if (table.is_stop_state(state)) {
+                    report(k, __offset + (p - begin));
+                }
+            }
+        }
+    }
+
+    // Marks the end of the stream. Only end-anchored matchers have anything left to report.
+    void stream_matcher::finish() {
+        start();
+        if (__end_anchored) {
+            for (size_t k = 0; k < __tables.size(); k++) {
+                if (__tables[k]->is_stop_state(__states[k])) {
+                    report(k, __offset);
+                }
+            }
+            flush();
+        }
+    }
+
+    void stream_matcher::reset() {
+        for (size_t k = 0; k < __tables.size(); k++) {
+            __states[k] = __tables[k]->start_state();
+        }
+        __offset = 0;
+        __started = false;
+        __pending.clear();
+    }
+
+    bool stream_matcher::is_dead() const {
+        for (size_t k = 0; k < __tables.size(); k++) {
+            if (__tables[k]->kind(__states[k]) != transition_table::DEAD) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // The empty match at offset 0 is reported once, before any input is consumed
+    void stream_matcher::start() {
+        if (!__started) {
+            __started = true;
+            if (!__end_anchored) {
+                for (size_t k = 0; k < __tables.size(); k++) {
+                    if (__tables[k]->is_stop_state(__states[k])) {
+                        report(k, 0);
+                    }
+                }
+                flush();
+            }
+        }
+    }
+
+    // A single table reports straight away; several wait for flush to unite their marks
+    void stream_matcher::report(size_t k, size_t end) {
+        const std::set<int>& marks = __tables[k]->state_mark(__states[k]);
+        if (__tables.size() == 1) {
+            if (__on_match) {
+                __on_match(end, marks);
+            }
+            return;
+        }
+        __pending[end].insert(marks.begin(), marks.end());
+    }
+
+    void stream_matcher::flush() {
+        if (__on_match) {
+            for (auto& [end, marks] : __pending) {
+                __on_match(end, marks);
+            }
+        }
+        __pending.clear();
+    }
+}
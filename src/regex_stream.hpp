@@ -0,0 +1,55 @@
+#ifndef REGEX_STREAM_HPP
+#define REGEX_STREAM_HPP
+
+#include <functional>
+#include <map>
+#include <set>
+#include <string_view>
+#include <vector>
+
+#include "regex_table.hpp"
+
+namespace regexs {
+    // Resumable matcher over input that arrives in chunks. Only the current table state
+    // and the absolute offset are kept between feeds, so memory does not grow with the
+    // stream, and chunks are scanned in place without being copied together.
+    //
+    // The callback receives the absolute end offset of every match and the marks of the
+    // state reached there. The tables must outlive the matcher.
+    //
+    // A matcher may run several tables side by side, such as the shards of a pattern
+    // set. Each chunk then goes through every table in turn, and matches that end at the
+    // same offset are reported once with the marks of all tables united.
+    class stream_matcher {
+    public:
+        using match_callback = std::function<void(size_t, const std::set<int>&)>;
+
+        // With end_anchored set, matches are only reported by finish()
+        stream_matcher(const transition_table& table, match_callback on_match, bool end_anchored = false);
+        stream_matcher(std::vector<const transition_table*> tables, match_callback on_match, bool end_anchored = false);
+
+        void feed(std::string_view chunk);
+        void finish();
+        void reset();
+
+        inline size_t offset() const { return __offset; }
+        // State of the first table
+        inline transition_table::state current_state() const { return __states[0]; }
+        bool is_dead() const;
+    private:
+        std::vector<const transition_table*> __tables;
+        match_callback __on_match;
+        bool __end_anchored;
+        std::vector<transition_table::state> __states;
+        size_t __offset;
+        bool __started;
+        std::map<size_t, std::set<int>> __pending;   // reports of several tables, by offset
+
+        void start();
+        void feed(size_t k, std::string_view chunk);
+        void report(size_t k, size_t end);
+        void flush();
+    };
+}
+
+#endif
@@ -0,0 +1,438 @@
+#include "regex_table.hpp"
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace regexs;
+using state = transition_table::state;
+
+// In line mode the delimiter gets a byte class of its own. Every state sends it to
+// one of two line end states, chosen by whether the line matched, and those copy
+// the start row so the next line starts without a reset.
+transition_table::transition_table(const deterministic_automaton& dfa, bool line_mode) : __line_mode(line_mode) {
+    __class_count = dfa.byte_classes(__classes);
+
+    unsigned char delimiter = static_cast<unsigned char>(LINE_DELIMITER);
+    if (line_mode) {
+        for (int b = 0; b < 256; b++) {
+            if (b != delimiter && __classes[b] == __classes[delimiter]) {
+                __classes[delimiter] = static_cast<unsigned char>(__class_count++);
+                break;
+            }
+        }
+    }
+
+    std::vector<unsigned char> class_byte(__class_count);
+    for (int b = 255; b >= 0; b--) {
+        class_byte[__classes[b]] = static_cast<unsigned char>(b);
+    }
+
+    // A state is live when some stop state is reachable from it
+    size_t n = dfa.state_count();
+    std::vector<std::vector<deterministic_automaton::state>> reverse_edges(n);
+    for (deterministic_automaton::state s = 0; s < n; s++) {
+        for (int b = 0; b < 256; b++) {
+            deterministic_automaton::state t = dfa.next_state(s, static_cast<char>(b));
+            if (t != deterministic_automaton::REJECT) {
+                reverse_edges[t].push_back(s);
+            }
+        }
+    }
+    std::vector<bool> live(n, false);
+    std::deque<deterministic_automaton::state> live_queue;
+    for (deterministic_automaton::state s = 0; s < n; s++) {
+        if (dfa.is_stop_state(s)) {
+            live[s] = true;
+            live_queue.push_back(s);
+        }
+    }
+    while (!live_queue.empty()) {
+        deterministic_automaton::state t = live_queue.front();
+        live_queue.pop_front();
+        for (deterministic_automaton::state s : reverse_edges[t]) {
+            if (!live[s]) {
+                live[s] = true;
+                live_queue.push_back(s);
+            }
+        }
+    }
+
+    __dead_state = static_cast<state>(n);
+    auto translate = [&](deterministic_automaton::state s) {
+        return (s == deterministic_automaton::REJECT || !live[s]) ? __dead_state : static_cast<state>(s);
+    };
+
+    size_t total = line_mode ? n + 3 : n + 1;
+    __table.assign(total * __class_count, __dead_state);
+    __stops.assign(total, false);
+    __kinds.assign(total, DEAD);
+    __escapes.assign(total, escape_set{0, {}});
+    __marks.resize(total);
+    __start_state = translate(dfa.start_state());
+
+    for (deterministic_automaton::state s = 0; s < n; s++) {
+        if (!live[s]) continue;
+
+        for (size_t k = 0; k < __class_count; k++) {
+            __table[s * __class_count + k] = translate(dfa.next_state(s, static_cast<char>(class_byte[k])));
+        }
+        __stops[s] = dfa.is_stop_state(s);
+        __marks[s] = dfa.state_mark(s);
+    }
+
+    if (line_mode) {
+        __line_unmatched_state = static_cast<state>(n + 1);
+        __line_matched_state = static_cast<state>(n + 2);
+        for (state s = 0; s <= __dead_state; s++) {
+            __table[s * __class_count + __classes[delimiter]] = __stops[s] ? __line_matched_state : __line_unmatched_state;
+        }
+        for (state s : {__line_unmatched_state, __line_matched_state}) {
+            std::copy_n(__table.begin() + __start_state * __class_count, __class_count, __table.begin() + s * __class_count);
+            __kinds[s] = LINE_END;
+        }
+    } else {
+        __line_unmatched_state = __line_matched_state = __dead_state;
+    }
+
+    for (state s = 0; s <= __dead_state; s++) {
+        if (!line_mode && (s == __dead_state || !live[s])) continue;
+
+        escape_set escapes{0, {}};
+        size_t escape_count = 0;
+        for (int b = 0; b < 256; b++) {
+            if (next_state(s, static_cast<char>(b)) != s) {
+                if (escape_count < MAX_ESCAPES) {
+                    escapes.bytes[escape_count] = static_cast<unsigned char>(b);
+                }
+                escape_count++;
+            }
+        }
+
+        if (escape_count == 0) {
+            __kinds[s] = __stops[s] ? ACCEPT_FOREVER : DEAD;
+        } else if (escape_count <= MAX_ESCAPES) {
+            __kinds[s] = ACCELERATED;
+            escapes.count = static_cast<unsigned char>(escape_count);
+            __escapes[s] = escapes;
+        } else {
+            __kinds[s] = NORMAL;
+        }
+    }
+
+    renumber(estimate_heat());
+    REGEX_PROFILED(__profile.resize(total, __class_count));
+}
+
+std::vector<double> transition_table::estimate_heat() const {
+    std::vector<double> class_weight(__class_count, 0.0);
+    for (int b = 0; b < 256; b++) {
+        class_weight[__classes[b]] += 1.0 / 256;
+    }
+
+    size_t n = state_count();
+    std::vector<double> heat(n, 0.0), mass(n, 0.0), next(n);
+    mass[__start_state] = 1.0;
+    for (size_t step = 0; step < HEAT_STEPS; step++) {
+        std::fill(next.begin(), next.end(), 0.0);
+        for (state s = 0; s < n; s++) {
+            if (mass[s] == 0.0 || __kinds[s] == DEAD || __kinds[s] == ACCEPT_FOREVER) continue;
+            heat[s] += mass[s];
+            for (size_t k = 0; k < __class_count; k++) {
+                next[__table[s * __class_count + k]] += mass[s] * class_weight[k];
+            }
+        }
+        mass.swap(next);
+    }
+    return heat;
+}
+
+void transition_table::renumber(const std::vector<double>& heat) {
+    size_t n = state_count();
+    std::vector<state> order(n);
+    for (state s = 0; s < n; s++) {
+        order[s] = s;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](state a, state b) { return heat[a] > heat[b]; });
+    std::vector<state> id(n);
+    for (state s = 0; s < n; s++) {
+        id[order[s]] = s;
+    }
+
+    std::vector<state> table(__table.size());
+    std::vector<bool> stops(n);
+    std::vector<state_kind> kinds(n);
+    std::vector<escape_set> escapes(n);
+    std::vector<std::set<int>> marks(n);
+    for (state s = 0; s < n; s++) {
+        state old = order[s];
+        for (size_t k = 0; k < __class_count; k++) {
+            table[s * __class_count + k] = id[__table[old * __class_count + k]];
+        }
+        stops[s] = __stops[old];
+        kinds[s] = __kinds[old];
+        escapes[s] = __escapes[old];
+        marks[s] = std::move(__marks[old]);
+    }
+
+    __table = std::move(table);
+    __stops = std::move(stops);
+    __kinds = std::move(kinds);
+    __escapes = std::move(escapes);
+    __marks = std::move(marks);
+    __start_state = id[__start_state];
+    __dead_state = id[__dead_state];
+    __line_unmatched_state = id[__line_unmatched_state];
+    __line_matched_state = id[__line_matched_state];
+    REGEX_PROFILED(__profile.resize(n, __class_count));
+}
+
+size_t transition_table::memory_usage() const {
+    return __table.size() * sizeof(state) + sizeof(__classes)
+         + __kinds.size() * (sizeof(state_kind) + sizeof(escape_set) + sizeof(std::set<int>)) + __stops.size() / 8;
+}
+
+const std::set<int>& transition_table::state_mark(state s) const {
+    return __marks[s];
+}
+
+const char* transition_table::kind_name(state_kind k) {
+    static const char* kind_names[] = {"NORMAL", "DEAD", "ACCEPT_FOREVER", "ACCELERATED", "LINE_END"};
+    return kind_names[k];
+}
+
+const table_profile* transition_table::profile() const {
+#ifdef REGEX_PROFILE
+    return &__profile;
+#else
+    return nullptr;
+#endif
+}
+
+void transition_table::reset_profile() const {
+    REGEX_PROFILED(__profile.reset());
+}
+
+// Advances over the whole input, leaving early once the state is dead or accepts forever
+state transition_table::run(state s, std::string_view sv) const {
+    const char* p = sv.data();
+    const char* end = p + sv.size();
+
+    while (p != end) {
+        switch (__kinds[s]) {
+        case NORMAL:
+        case LINE_END:
+            break;
+        case DEAD:
+        case ACCEPT_FOREVER:
+            REGEX_PROFILED(__profile.end_run(s, end - p));
+            return s;
+        case ACCELERATED:
+            {
+                REGEX_PROFILED(const char* from = p);
+                p = skip_loop(s, p, end);
+                REGEX_PROFILED(__profile.skip(s, p - from));
+            }
+            if (p == end) {
+                REGEX_PROFILED(__profile.end_run(s, 0));
+                return s;
+            }
+            break;
+        }
+        REGEX_PROFILED(__profile.step(s, __classes[static_cast<unsigned char>(*p)]));
+        s = next_state(s, *p++);
+    }
+
+    REGEX_PROFILED(__profile.end_run(s, 0));
+    return s;
+}
+
+// Advances until a stop state is entered, the state dies, or the input ends.
+// p is left just past the byte that entered the stop state.
+state transition_table::run_to_stop(state s, const char*& p, const char* end) const {
+    while (!__stops[s] && p != end) {
+        switch (__kinds[s]) {
+        case NORMAL:
+        case ACCEPT_FOREVER:
+        case LINE_END:
+            break;
+        case DEAD:
+            return s;
+        case ACCELERATED:
+            {
+                REGEX_PROFILED(const char* from = p);
+                p = skip_loop(s, p, end);
+                REGEX_PROFILED(__profile.skip(s, p - from));
+            }
+            if (p == end) return s;
+            break;
+        }
+        REGEX_PROFILED(__profile.step(s, __classes[static_cast<unsigned char>(*p)]));
+        s = next_state(s, *p++);
+    }
+
+    return s;
+}
+
+// Runs every input from the start state and stores its final state. Up to BATCH_LANES
+// inputs advance side by side, one byte each per step, so their table loads do not
+// wait on each other. Each round runs as many steps as the shortest lane has left,
+// capped so that lanes reaching a dead state are retired early.
+void transition_table::run_batch(const std::string_view* inputs, size_t count, state* results) const {
+    const char* ptrs[BATCH_LANES];
+    size_t remaining[BATCH_LANES];
+    size_t indices[BATCH_LANES];
+    state states[BATCH_LANES];
+
+    size_t active = 0, next = 0;
+    auto load = [&](size_t lane) {
+        ptrs[lane] = inputs[next].data();
+        remaining[lane] = inputs[next].size();
+        indices[lane] = next;
+        states[lane] = __start_state;
+        next++;
+    };
+    for (; active < BATCH_LANES && next < count; active++) {
+        load(active);
+    }
+
+    while (active > 0) {
+        size_t steps = std::min(remaining[0], BATCH_ROUND);
+        for (size_t i = 1; i < active; i++) {
+            steps = std::min(steps, remaining[i]);
+        }
+
+        for (size_t k = 0; k < steps; k++) {
+            for (size_t i = 0; i < active; i++) {
+                REGEX_PROFILED(__profile.step(states[i], __classes[static_cast<unsigned char>(ptrs[i][k])]));
+                states[i] = next_state(states[i], ptrs[i][k]);
+            }
+        }
+
+        for (size_t i = 0; i < active; i++) {
+            ptrs[i] += steps;
+            remaining[i] -= steps;
+        }
+
+        for (size_t i = 0; i < active; ) {
+            if (remaining[i] != 0 && (__kinds[states[i]] == NORMAL || __kinds[states[i]] == ACCELERATED)) {
+                i++;
+                continue;
+            }
+
+            results[indices[i]] = states[i];
+            REGEX_PROFILED(__profile.end_run(states[i], remaining[i]));
+            if (next < count) {
+                load(i);
+                i++;
+            } else {
+                active--;
+                ptrs[i] = ptrs[active];
+                remaining[i] = remaining[active];
+                indices[i] = indices[active];
+                states[i] = states[active];
+            }
+        }
+    }
+}
+
+// Line mode only. Calls on_line with the bounds of every line that contains a match,
+// excluding the delimiter. A last line without a delimiter is reported as well.
+void transition_table::scan_lines(std::string_view buffer, const line_callback& on_line) const {
+    if (!__line_mode) {
+        throw std::logic_error("scan_lines needs a table built in line mode");
+    }
+
+    const char* data = buffer.data();
+    const char* p = data;
+    const char* end = data + buffer.size();
+    const char* line_begin = data;
+    state s = __start_state;
+
+    while (p != end) {
+        switch (__kinds[s]) {
+        case LINE_END:
+            if (s == __line_matched_state) {
+                on_line(line_begin - data, p - 1 - data);
+            }
+            line_begin = p;
+            break;
+        case ACCELERATED:
+            {
+                REGEX_PROFILED(const char* from = p);
+                p = skip_loop(s, p, end);
+                REGEX_PROFILED(__profile.skip(s, p - from));
+            }
+            if (p == end) continue;
+            break;
+        default:
+            break;
+        }
+        REGEX_PROFILED(__profile.step(s, __classes[static_cast<unsigned char>(*p)]));
+        s = next_state(s, *p++);
+    }
+
+    if (__kinds[s] == LINE_END) {
+        if (s == __line_matched_state) {
+            on_line(line_begin - data, p - 1 - data);
+        }
+    } else if (line_begin != end && __stops[s]) {
+        on_line(line_begin - data, end - data);
+    }
+}
+
+// Returns the first position holding one of the escape bytes of s, or end
+const char* transition_table::skip_loop(state s, const char* p, const char* end) const {
+    const escape_set& esc = __escapes[s];
+    if (esc.count == 1) {
+        const void* found = std::memchr(p, esc.bytes[0], end - p);
+        return found ? static_cast<const char*>(found) : end;
+    }
+
+#ifdef __SSE2__
+    __m128i e0 = _mm_set1_epi8(static_cast<char>(esc.bytes[0]));
+    __m128i e1 = _mm_set1_epi8(static_cast<char>(esc.bytes[1]));
+    __m128i e2 = _mm_set1_epi8(static_cast<char>(esc.bytes[esc.count - 1]));
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i hits = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, e0), _mm_cmpeq_epi8(v, e1)),
+            _mm_cmpeq_epi8(v, e2)
+        );
+        int mask = _mm_movemask_epi8(hits);
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+#endif
+
+    for (; p != end; p++) {
+        unsigned char c = static_cast<unsigned char>(*p);
+        for (size_t i = 0; i < esc.count; i++) {
+            if (c == esc.bytes[i]) return p;
+        }
+    }
+    return end;
+}
+
+std::string transition_table::serialize() const {
+    std::stringstream seri_stream;
+    seri_stream << "CLASSES = " << __class_count << '\n';
+    for (state s = 0; s < state_count(); s++) {
+        seri_stream << "STATE" << s << " " << kind_name(__kinds[s]) << ": {";
+        for (size_t k = 0; k < __class_count; k++) {
+            if (k) seri_stream << ", ";
+            seri_stream << __table[s * __class_count + k];
+        }
+        seri_stream << "}\n";
+    }
+    seri_stream << "START_STATE = " << __start_state << '\n';
+    seri_stream << "DEAD_STATE = " << __dead_state << '\n';
+    return seri_stream.str();
+}
@@ -0,0 +1,102 @@
+#ifndef REGEX_TABLE_HPP
+#define REGEX_TABLE_HPP
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "regex_dfa.hpp"
+#include "regex_profile.hpp"
+
+namespace regexs {
+    // Flat form of a deterministic_automaton used for matching. Rows are indexed by
+    // byte class, and every state that can no longer reach a stop state is folded
+    // into a single dead state, so REJECT never shows up in the table. States are
+    // numbered hottest first, so the rows the byte loop keeps reading share cache lines.
+    class transition_table {
+    public:
+        using state = uint32_t;
+
+        enum state_kind : unsigned char {
+            NORMAL,         // no shortcut
+            DEAD,           // can never reach a stop state
+            ACCEPT_FOREVER, // stop state that every byte loops back to
+            ACCELERATED,    // loops back to itself on all but a few escape bytes
+            LINE_END        // line mode: just consumed a delimiter
+        };
+
+        static constexpr size_t MAX_ESCAPES = 3;
+        static constexpr size_t BATCH_LANES = 16;
+        static constexpr size_t BATCH_ROUND = 32;
+        static constexpr char LINE_DELIMITER = '\n';
+        static constexpr size_t HEAT_STEPS = 16;
+
+        using line_callback = std::function<void(size_t, size_t)>;
+
+        explicit transition_table(const deterministic_automaton& dfa, bool line_mode = false);
+
+        inline size_t state_count() const { return __kinds.size(); }
+        inline size_t class_count() const { return __class_count; }
+        inline const deterministic_automaton::byte_class_map& byte_classes() const { return __classes; }
+        size_t memory_usage() const;
+
+        inline state start_state() const { return __start_state; }
+        inline state dead_state() const { return __dead_state; }
+        inline state next_state(state s, char ch) const {
+            return __table[s * __class_count + __classes[static_cast<unsigned char>(ch)]];
+        }
+        inline state class_next_state(state s, size_t cls) const { return __table[s * __class_count + cls]; }
+        inline bool is_stop_state(state s) const { return __stops[s]; }
+        inline state_kind kind(state s) const { return __kinds[s]; }
+        static const char* kind_name(state_kind k);
+        const std::set<int>& state_mark(state s) const;
+
+        state run(state s, std::string_view sv) const;
+        state run_to_stop(state s, const char*& p, const char* end) const;
+        void run_batch(const std::string_view* inputs, size_t count, state* results) const;
+        void scan_lines(std::string_view buffer, const line_callback& on_line) const;
+
+        // Expected bytes read in each state over the first HEAT_STEPS bytes of uniformly
+        // random input. The loops leave dead and accept-forever states at once, so those
+        // get none.
+        std::vector<double> estimate_heat() const;
+        // Renumbers the states by decreasing heat, e.g. the visits of a profile, keeping
+        // the current order among equals
+        void renumber(const std::vector<double>& heat);
+
+        // Counters of a build with REGEX_PROFILE defined, or nullptr without it
+        const table_profile* profile() const;
+        void reset_profile() const;
+
+        std::string serialize() const;
+    private:
+        struct escape_set {
+            unsigned char count;
+            std::array<unsigned char, MAX_ESCAPES> bytes;
+        };
+
+        deterministic_automaton::byte_class_map __classes;
+        size_t __class_count;
+        std::vector<state> __table;
+        std::vector<bool> __stops;
+        std::vector<state_kind> __kinds;
+        std::vector<escape_set> __escapes;
+        std::vector<std::set<int>> __marks;
+        state __start_state;
+        state __dead_state;
+        bool __line_mode;
+        state __line_unmatched_state;
+        state __line_matched_state;
+#ifdef REGEX_PROFILE
+        mutable table_profile __profile;
+#endif
+
+        const char* skip_loop(state s, const char* p, const char* end) const;
+    };
+}
+
+#endif